@@ -24,8 +24,16 @@
 
 #define DRIVER_NAME "chromefb"
 
-/* Build in extra debug information */
-#define DBG(x)  printk(KERN_DEBUG "chromefb: %s\n", (x));
+/* Extra debug information, switched at runtime through the debug parameter */
+extern int chrome_debug;
+
+#define CHROME_DEBUG(format, args...) \
+        do { \
+                if (unlikely(chrome_debug)) \
+                        printk(KERN_DEBUG format, ## args); \
+        } while (0)
+
+#define DBG(x)  CHROME_DEBUG("chromefb: %s\n", (x))
 
 /* All Unichrome and Chrome devices that this driver should support.
  * Introduce own, but only sensible, chip naming */
@@ -45,6 +53,10 @@
 #define HOST_BRIDGE_P4M800 0x0296
 #define HOST_BRIDGE_K8M800 0x0204
 
+/* How the cpu reaches the framebuffer */
+#define CHROME_APERTURE_PCI     0
+#define CHROME_APERTURE_DIRECT  1
+
 /* Track the type of RAM being used */
 #define RAM_TYPE_DDR200 0
 #define RAM_TYPE_DDR266 1
@@ -64,9 +76,13 @@ struct chrome_state {
         unsigned char AR[0x14];
         unsigned char Misc;
 
-        /* all four 4 VGA FB planes (0xA0000) */
+        /* VGA FB planes 0 to 2 (0xA0000): text, attributes and font, each
+         * run length encoded. Plane 3 is not used in textmode. */
 #define VGA_FB_PLANE_SIZE 64*1024
+#define VGA_FB_PLANES_STORED 3
         unsigned char *planes;
+        unsigned int planes_size;
+        unsigned int planes_offset[VGA_FB_PLANES_STORED];
 
         /* DAC */
         struct {
@@ -84,6 +100,204 @@ struct chrome_state {
         unsigned char fb_sr02, fb_sr04, fb_sr1a;
 };
 
+/*
+ * A complete register image for a mode, built and validated up front, and
+ * then committed in one go.
+ */
+#define CHROME_REG_MISC  0
+#define CHROME_REG_SR    1
+#define CHROME_REG_CR    2
+#define CHROME_REG_GR    3
+#define CHROME_REG_AR    4
+
+struct chrome_reg {
+        unsigned char bank;
+        unsigned char index;
+        unsigned char value;
+        unsigned char mask;
+};
+
+#define CHROME_MODE_REGS_MAX 128
+
+struct chrome_mode_regs {
+        int  count;
+        struct chrome_reg  regs[CHROME_MODE_REGS_MAX];
+
+        __u32  pll;
+
+        /* timing, in pixels and lines, for the scanline estimate */
+        __u32  htotal;
+        __u32  vtotal;
+        __u32  vsync_start;
+};
+
+/*
+ * A validated mode from the modelist, with its register image. request is
+ * what came in, mode what chrome_mode_valid() made of it.
+ */
+struct chrome_mode_image {
+        struct fb_var_screeninfo  request;
+        struct fb_var_screeninfo  mode;
+        struct chrome_mode_regs  regs;
+};
+
+#define CHROME_MODE_IMAGES 128
+
+void chrome_mode_reg(struct chrome_mode_regs *regs, unsigned char bank,
+                     unsigned char index, unsigned char value,
+                     unsigned char mask);
+
+#define chrome_reg_misc(regs, value) \
+	chrome_mode_reg((regs), CHROME_REG_MISC, 0, (value), 0xFF)
+#define chrome_reg_sr(regs, index, value, mask) \
+	chrome_mode_reg((regs), CHROME_REG_SR, (index), (value), (mask))
+#define chrome_reg_cr(regs, index, value, mask) \
+	chrome_mode_reg((regs), CHROME_REG_CR, (index), (value), (mask))
+#define chrome_reg_gr(regs, index, value, mask) \
+	chrome_mode_reg((regs), CHROME_REG_GR, (index), (value), (mask))
+#define chrome_reg_ar(regs, index, value, mask) \
+	chrome_mode_reg((regs), CHROME_REG_AR, (index), (value), (mask))
+
+/*
+ * What differs between the supported chips, see chrome_chip.c.
+ */
+#define CHROME_CAP_ACCEL  0x01 /* usable 2D engine */
+#define CHROME_CAP_SCALER_FINE  0x02 /* 12bit/11bit panel scaling factors */
+
+/* 2D engine STATUS */
+#define CHROME_STATUS_2D_BUSY     0x00000002
+#define CHROME_STATUS_CMD_BUSY    0x00000080
+#define CHROME_STATUS_QUEUE_BUSY  0x00020000
+#define CHROME_STATUS_BUSY \
+	(CHROME_STATUS_2D_BUSY | CHROME_STATUS_CMD_BUSY | CHROME_STATUS_QUEUE_BUSY)
+
+struct chrome_info;
+
+struct chrome_chip {
+        unsigned int  id;
+        const char  *name;
+        unsigned int  caps;
+
+        /* limits, in bytes */
+        __u32  pan_max; /* furthest start address */
+        __u32  pitch_max; /* CR13 offset */
+        __u32  fetch_max; /* SR1C/SR1D fetch count */
+
+        /* PLL: solver and decoder, and the register encoding */
+        __u32  (*pll_generate)(int clock, int *diff);
+        int  (*pll_clock)(__u32 pll);
+        void  (*pll_set)(struct chrome_info *info, __u32 pll);
+        __u32  (*pll_get)(struct chrome_info *info);
+
+        /* display FIFO, added to the register image */
+        void  (*fifo)(struct chrome_mode_regs *regs,
+                      struct fb_var_screeninfo *mode);
+
+        /* 2D engine */
+        u32  engine_busy; /* STATUS bits to wait on */
+        int  engine_max_y; /* coordinates are rebased beyond this */
+};
+
+/*
+ * 2D engine arbitration, between fbcon and userspace clients.
+ */
+#define CHROME_ENGINE_FBCON   0
+#define CHROME_ENGINE_USER    1
+#define CHROME_ENGINE_OWNERS  2
+
+/* GEMODE up to MONOPAT1 */
+#define CHROME_ENGINE_STATE_REGS 16
+
+struct chrome_engine {
+        spinlock_t  lock;
+
+        int  owner; /* who programmed the engine last */
+        int  holder; /* tgid that took it, or 0; dropped on the last close */
+        int  pending; /* engine might still be busy */
+
+        /* state of each owner, for while the other one has the engine */
+        u32  state[CHROME_ENGINE_OWNERS][CHROME_ENGINE_STATE_REGS];
+
+        /* fbcon operations kicked off, and how many of those are known
+         * to be done; sync sleepers wait on these */
+        u32  seq_queued;
+        u32  seq_done;
+        wait_queue_head_t  wait;
+
+        /* how long a sync spins before it sleeps, from the average wait */
+        u32  spin_ns;
+        u32  wait_avg_ns;
+
+        /* what fbcon last wrote, so unchanged registers can be skipped */
+        u32  cache[CHROME_ENGINE_STATE_REGS];
+        u32  cache_valid; /* a bit per register */
+
+        /* in debugfs */
+        u32  acquires;
+        u32  handovers;
+        u32  contended;
+        u32  syncs;
+        u32  cache_hits;
+        u32  cache_misses;
+        u32  sync_spins;
+        u32  sync_sleeps;
+        u32  sync_wait_us;
+};
+
+/*
+ * What the cpu and the engine manage on this board, measured at probe, and
+ * what got picked from that. See chrome_calibrate.c.
+ */
+struct chrome_calibration {
+        int  done;
+
+        u32  cpu_write_mbps;
+        u32  cpu_read_mbps;
+        u32  mmio_read_ns;
+        u32  engine_setup_ns;
+        u32  engine_fill_mbps;
+        u32  engine_copy_mbps;
+
+        /* below this many bytes, the cpu draws. ~0: the engine never does */
+        u32  fill_min;
+        u32  copy_min;
+        int  reads_fast;
+        int  shadow; /* draw into system memory, even when not rotated */
+};
+
+/*
+ * Shadow of the 8bpp LUT, see chrome_lut.c.
+ */
+struct chrome_lut {
+        spinlock_t  lock;
+        u8  entries[0x100][3];
+        /* entries that are, or will be, in the hardware as in the shadow */
+        DECLARE_BITMAP(known, 0x100);
+        int  dirty_start, dirty_end;
+        int  setup; /* DAC mask and overscan */
+        int  pending;
+
+        /* what the worker writes out, copied from entries under the lock */
+        u8  upload[0x100][3];
+
+        u32  uploads;
+        u32  uploaded;
+        u32  coalesced;
+};
+
+/*
+ * What a userspace client left in the hardware, see chrome_vt.c.
+ */
+struct chrome_vt_snapshot {
+        u64  stamp;
+        /* read back, in the layout of the console image */
+        struct chrome_mode_regs  regs;
+        u32  cursor;
+        u32  engine[CHROME_ENGINE_STATE_REGS];
+};
+
+#define CHROME_DEBUGFS_FILES 32
+
 /*
  * Holds all our information.
  */
@@ -93,6 +307,7 @@ struct chrome_info {
         struct pci_dev  *pci_dev;
 
         unsigned int  id;
+        const struct chrome_chip  *chip;
 
         unsigned int  host;
         unsigned char host_rev;
@@ -102,12 +317,112 @@ struct chrome_info {
         void __iomem  *fbbase;
         unsigned int  fbsize;
 
+        /* ways for the cpu to get to the framebuffer, and which one is in
+         * use, see chrome_fb_init() */
+        unsigned int  fb_pci; /* BAR 0 */
+        unsigned int  fb_direct; /* host bridge window, or 0 */
+        int  fb_aperture;
+        int  fb_mtrr; /* write combining, or -1 */
+
         void __iomem  *iobase;
 
         atomic_t  fb_ref_count;
 
+        /* mode that is live on the CRTC, from firmware or probe, until
+         * the first set_par */
+        int  mode_adopted;
+        struct fb_var_screeninfo  mode_firmware;
+
+        /* output= option: the CRTC runs this timing, and the panel scaler
+         * stretches smaller framebuffers to it */
+        int  scale;
+        struct fb_var_screeninfo  mode_output;
+
+        /* lines at the bottom that show the framebuffer from offset 0 */
+        __u32  split;
+
+        /* deferred textmode capture and initial modeset */
+        struct work_struct  init_work;
+        struct workqueue_struct  *init_wq;
+        struct completion  init_done;
+        int  init_ready;
+
+        /* FB_BLANK_* level, survives set_par */
+        u32  blank;
+
+        struct chrome_lut  lut;
+        struct work_struct  lut_work;
+        struct workqueue_struct  *lut_wq;
+        /* the AR flip-flop and the DAC index: the LUT worker against
+         * modesets and readbacks */
+        spinlock_t  vga_lock;
+
+        /* console colours for truecolor modes, packed for the current bpp */
+        u32  pseudo_palette[16];
+
         struct chrome_state state;
 
+        int  accel;
+        struct chrome_engine  engine;
+        struct chrome_calibration  calib;
+
+        /* software rendering, picked per bpp at set_par */
+        const struct chrome_soft  *soft;
+        u8  *soft_line;
+        u32  soft_line_size;
+
+        /* rotation: a shadow in system memory, rotated into the scanout,
+         * or copied as is when calibration prefers a shadow */
+        int  rotate;
+        u8  *shadow;
+        __u32  shadow_size;
+        __u32  rotate_pitch;
+        atomic_t  shadow_maps;
+        spinlock_t  damage_lock;
+        int  damage_x1, damage_y1, damage_x2, damage_y2;
+        struct delayed_work  rotate_work;
+        u32  rotate_flushes;
+        u32  rotate_pixels;
+        u32  rotate_flush_ns;
+
+        /* scanline estimate: time of the last retrace start seen, and the
+         * timing of the mode that is live */
+        u64  scan_stamp;
+        __u32  scan_line_ps;
+        __u32  scan_total;
+        __u32  scan_sync;
+
+        /* register images for the modelist, see chrome_modelist.c */
+        struct chrome_mode_image  *mode_images;
+        int  mode_image_count;
+        u32  mode_image_hits;
+        u32  mode_image_misses;
+
+        /* VT switches, see chrome_vt.c */
+        atomic_t  vt_clients;
+        int  vt_dirty;
+        struct chrome_vt_snapshot  *vt_user;
+        struct chrome_mode_regs  vt_console;
+        struct fb_var_screeninfo  vt_mode; /* last set_par, restored as is */
+        u32  vt_restores;
+        u32  vt_restore_writes;
+        u32  vt_restore_ns;
+        u32  vt_restore_max_ns;
+
+        /* mode commit latency, in debugfs */
+        u32  mode_commit_ns;
+        u32  mode_commit_max_ns;
+        u32  mode_vblank_wait_ns;
+
+        /* register write trace, see chrome_trace.c */
+        u32  trace_enable;
+        atomic_t  trace_head;
+        struct chrome_trace_record  *trace_ring;
+
+        struct dentry  *debugfs_dir;
+        struct dentry  *debugfs_files[CHROME_DEBUGFS_FILES];
+        int  debugfs_count;
+
 #if 0
         struct list_head  *crtcs;
         struct list_head  *outputs;
@@ -125,11 +440,191 @@ struct chrome_output {
 };
 #endif
 
+/* from chrome_accel.c */
+void chrome_accel_init(struct chrome_info *info);
+int chrome_engine_acquire(struct chrome_info *info, int owner,
+                          unsigned long *flags);
+void chrome_engine_release(struct chrome_info *info, unsigned long flags);
+int chrome_engine_lock(struct chrome_info *info, int tgid);
+void chrome_engine_unlock(struct chrome_info *info, int tgid);
+void chrome_engine_cpu(struct chrome_info *info);
+void chrome_engine_invalidate(struct chrome_info *info);
+void chrome_engine_suspend(struct chrome_info *info);
+void chrome_engine_resume(struct chrome_info *info);
+int chrome_engine_replay(struct chrome_info *info, u32 *state);
+int chrome_engine_sync(struct chrome_info *info, int sleep);
+void chrome_engine_calibrate(struct chrome_info *info, unsigned long offset,
+                             unsigned long size);
+void chrome_fillrect(struct fb_info *fb_info, const struct fb_fillrect *rect);
+void chrome_copyarea(struct fb_info *fb_info, const struct fb_copyarea *area);
+void chrome_imageblit(struct fb_info *fb_info, const struct fb_image *image);
+
+/* from chrome_calibrate.c */
+void chrome_calibrate(struct chrome_info *info);
+u32 chrome_calibrate_rate(u32 bytes, u64 ns);
+
+/* from chrome_chip.c */
+int chrome_chip_select(struct chrome_info *info);
+
+/* from chrome_debugfs.c */
+void chrome_debugfs_init(struct chrome_info *info);
+void chrome_debugfs_exit(struct chrome_info *info);
+void chrome_debugfs_u32(struct chrome_info *info, const char *name, u32 *value);
+void chrome_debugfs_bool(struct chrome_info *info, const char *name, u32 *value);
+struct file_operations;
+void chrome_debugfs_file(struct chrome_info *info, const char *name, int mode,
+                         void *data, const struct file_operations *fops);
+
 /* from chrome_host.c */
 int chrome_host(struct chrome_info *info);
 
+/*
+ * Time in ns, for the latency statistics.
+ */
+static inline u64
+chrome_time_ns(void)
+{
+        struct timespec ts;
+
+        getnstimeofday(&ts);
+        return (u64) ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static inline u32
+chrome_time_us(u64 ns)
+{
+        do_div(ns, 1000);
+        return ns;
+}
+
+/*
+ * A console colour as it goes into the framebuffer.
+ */
+static inline u32
+chrome_colour(struct fb_info *fb_info, u32 colour)
+{
+        if (fb_info->fix.visual == FB_VISUAL_TRUECOLOR)
+                return ((u32 *) fb_info->pseudo_palette)[colour];
+        return colour;
+}
+
+/*
+ * Anything that touches the display waits for the deferred part of probe.
+ */
+static inline void
+chrome_init_wait(struct chrome_info *info)
+{
+        if (unlikely(!info->init_ready))
+                wait_for_completion(&info->init_done);
+}
+
+/* from chrome_lut.c */
+void chrome_lut_init(struct chrome_info *info);
+void chrome_lut_exit(struct chrome_info *info);
+void chrome_lut_flush(struct chrome_info *info);
+void chrome_lut_set(struct chrome_info *info, struct fb_cmap *cmap);
+void chrome_lut_invalidate(struct chrome_info *info);
+
 /* from chrome_mode.c */
+void chrome_mode_init(struct chrome_info *info);
+void chrome_scaler_init(struct chrome_info *info, const char *option);
 int chrome_mode_valid(struct chrome_info *info, struct fb_var_screeninfo *mode);
+int chrome_mode_build(struct chrome_info *info, struct fb_var_screeninfo *mode,
+                      struct chrome_mode_regs *regs);
+void chrome_mode_commit(struct chrome_info *info, struct chrome_mode_regs *regs);
+int chrome_mode_prepare(struct chrome_info *info, struct fb_var_screeninfo *mode,
+                        struct chrome_mode_regs *regs);
 int chrome_mode_write(struct chrome_info *info, struct fb_var_screeninfo *mode);
+int chrome_mode_split(struct chrome_info *info, __u32 lines);
+void chrome_mode_regs_read(struct chrome_info *info,
+                           struct chrome_mode_regs *regs,
+                           struct chrome_mode_regs *current_regs);
+int chrome_mode_replay(struct chrome_info *info, struct chrome_mode_regs *regs,
+                       struct chrome_mode_regs *current_regs);
+__u32 chrome_mode_start(struct fb_var_screeninfo *mode, __u32 line_length);
+int chrome_vblank_wait(struct chrome_info *info);
+void chrome_scanline_mode(struct chrome_info *info, struct fb_var_screeninfo *mode);
+int chrome_scanline(struct chrome_info *info);
+int chrome_scanline_wait(struct chrome_info *info, int top, int bottom);
+int chrome_mode_read(struct chrome_info *info, struct fb_var_screeninfo *mode);
+int chrome_mode_equal(struct fb_var_screeninfo *a, struct fb_var_screeninfo *b);
+
+/* from chrome_copy.c */
+struct chromefb_capture;
+ssize_t chrome_fb_read(struct fb_info *fb_info, char __user *buf, size_t count,
+                       loff_t *ppos);
+ssize_t chrome_fb_write(struct fb_info *fb_info, const char __user *buf,
+                        size_t count, loff_t *ppos);
+int chrome_capture(struct chrome_info *info, struct chromefb_capture *capture);
+
+/* from chrome_sysfs.c */
+void chrome_sysfs_init(struct chrome_info *info);
+void chrome_sysfs_exit(struct chrome_info *info);
+
+/* from chrome_modelist.c */
+void chrome_modelist_init(struct chrome_info *info, const char *mode_option);
+void chrome_modelist_build(struct chrome_info *info, const char *mode_option);
+void chrome_modelist_exit(struct chrome_info *info);
+struct chrome_mode_image *chrome_mode_image_find(struct chrome_info *info,
+                                                 struct fb_var_screeninfo *mode);
+void chrome_mode_image_add(struct chrome_info *info,
+                           struct fb_var_screeninfo *request,
+                           struct fb_var_screeninfo *mode,
+                           struct chrome_mode_regs *regs);
+int chrome_mode_image_valid(struct chrome_info *info,
+                            struct fb_var_screeninfo *mode);
+
+/* from chrome_vt.c */
+int chrome_vt_restore(struct chrome_info *info, struct fb_var_screeninfo *mode);
+void chrome_vt_open(struct chrome_info *info);
+int chrome_vt_release(struct chrome_info *info);
+void chrome_vt_init(struct chrome_info *info);
+void chrome_vt_exit(struct chrome_info *info);
+
+/* from chrome_trace.c */
+void chrome_trace(struct chrome_info *info, int bank, u32 index, u32 old,
+                  u32 value, int flags);
+void chrome_trace_op(struct chrome_info *info, int op, u64 start, int ret,
+                     u32 value, u16 arg);
+void chrome_trace_init(struct chrome_info *info);
+void chrome_trace_exit(struct chrome_info *info);
+
+/*
+ * Start of a traced op, or 0 when tracing is off.
+ */
+static inline u64
+chrome_trace_start(struct chrome_info *info)
+{
+        if (unlikely(info->trace_enable))
+                return chrome_time_ns();
+        return 0;
+}
+
+#define CHROME_TRACE_DONE(info, op, start, ret, value, arg) \
+        do { \
+                if (unlikely(start)) \
+                        chrome_trace_op((info), (op), (start), (ret), \
+                                        (value), (arg)); \
+        } while (0)
+
+/* from chrome_soft.c */
+void chrome_soft_init(struct chrome_info *info);
+void chrome_soft_exit(struct chrome_info *info);
+void chrome_soft_select(struct chrome_info *info);
+void chrome_soft_fillrect(struct fb_info *fb_info,
+                          const struct fb_fillrect *rect);
+void chrome_soft_copyarea(struct fb_info *fb_info,
+                          const struct fb_copyarea *area);
+void chrome_soft_imageblit(struct fb_info *fb_info,
+                           const struct fb_image *image);
+
+/* from chrome_rotate.c */
+void chrome_rotate_init(struct chrome_info *info);
+void chrome_rotate_exit(struct chrome_info *info);
+int chrome_rotate_set(struct chrome_info *info);
+void chrome_rotate_damage(struct chrome_info *info, int x, int y, int width,
+                          int height);
+void chrome_rotate_flush(struct chrome_info *info);
+int chrome_rotate_mmap(struct chrome_info *info, struct vm_area_struct *vma);
 
 #endif /* HAVE_CHROMEFB_H */
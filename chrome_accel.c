@@ -0,0 +1,824 @@
+/*
+ * chromefb: driver for VIAs UniChrome and Chrome IGP graphics.
+ *
+ * Copyright (c) 2007 by Luc Verhaegen (libv@skynet.be)
+ *
+ * This file is subject to the terms and conditions of the GNU General
+ * Public License.  See the file COPYING in the main directory of this
+ * archive for more details.
+ *
+ * This code of course borrows heavily of my xf86-video-unichrome code.
+ * Care has been taken to only use that code that's fully my work.
+ *
+ */
+/*
+ * 2D engine: solid fills and screen to screen copies, and the arbitration
+ * of the engine between fbcon and userspace clients that drive it directly
+ * through the mmio mapping.
+ *
+ * Ownership only ever changes hands through chrome_engine_acquire() and
+ * chrome_engine_lock(). This is where we wait for the engine to go idle
+ * and where the state of the previous owner is saved and the state of the
+ * new owner is restored. When nothing changes hands, acquiring costs a
+ * spinlock and a compare. Kernel side operations keep that spinlock until
+ * they are kicked off, so that neither a client taking the engine nor a
+ * second kernel caller can come in halfway.
+ *
+ * fbcon mostly repeats the same mode, pitch, bases and colours, so its
+ * register writes go through a cache of what is in the engine already,
+ * and only the registers that differ are written out.
+ *
+ * fb_sync spins for about as long as operations have been taking, and
+ * then sleeps until the engine is done. CLE266, KM400 and K8M800 have no
+ * engine idle or command sequence interrupt that we know of, so sleepers
+ * look again every jiffy, and whoever sees the engine go idle first wakes
+ * up the others.
+ */
+
+#include <linux/fb.h>
+#include <linux/spinlock.h>
+#include <linux/sched.h>
+#include <linux/wait.h>
+#include <linux/interrupt.h>
+
+#include "chrome.h"
+#include "chrome_io.h"
+
+/*
+ * 2D engine registers, as found on CLE266, KM400/P4M800 and K8M800.
+ */
+#define CHROME_GE_GECMD        0x000
+#define CHROME_GE_GEMODE       0x004
+#define CHROME_GE_SRCPOS       0x008
+#define CHROME_GE_DSTPOS       0x00C
+#define CHROME_GE_DIMENSION    0x010
+#define CHROME_GE_FGCOLOR      0x018
+#define CHROME_GE_BGCOLOR      0x01C
+#define CHROME_GE_KEYCONTROL   0x02C
+#define CHROME_GE_SRCBASE      0x030
+#define CHROME_GE_DSTBASE      0x034
+#define CHROME_GE_PITCH        0x038
+
+#define CHROME_GE_STATUS       0x400
+
+/* GECMD */
+#define CHROME_GEC_BLT           0x00000001
+#define CHROME_GEC_DECY          0x00004000
+#define CHROME_GEC_DECX          0x00008000
+#define CHROME_GEC_FIXCOLOR_PAT  0x00002000
+#define CHROME_GEC_ROP(rop)      ((rop) << 24)
+
+/* GEMODE */
+#define CHROME_GEM_8BPP   0x00000000
+#define CHROME_GEM_16BPP  0x00000100
+#define CHROME_GEM_32BPP  0x00000300
+
+#define CHROME_PITCH_ENABLE  0x80000000
+
+/*
+ * Wait for the engine to go idle.
+ */
+static int
+chrome_engine_idle(struct chrome_info *info)
+{
+	int i;
+
+	for (i = 0; i < 0x100000; i++)
+		if (!(chrome_mmio_read(info, CHROME_GE_STATUS) &
+		      info->chip->engine_busy))
+			return 0;
+
+	printk(KERN_ERR "%s: 2D engine hangs (0x%08X).\n", __func__,
+	       chrome_mmio_read(info, CHROME_GE_STATUS));
+
+	/* no telling what state it is in when it comes back */
+	info->engine.cache_valid = 0;
+	return -EBUSY;
+}
+
+/*
+ * Register write for fbcon, skipped when the engine has the value already.
+ * Not for GECMD, that one kicks off an operation.
+ */
+static inline void
+chrome_engine_write(struct chrome_info *info, u32 offset, u32 value)
+{
+	struct chrome_engine *engine = &info->engine;
+	int i = (offset - CHROME_GE_GEMODE) >> 2;
+
+	if ((engine->cache_valid & (1 << i)) && (engine->cache[i] == value)) {
+		engine->cache_hits++;
+		return;
+	}
+
+	chrome_mmio_write(info, offset, value);
+	engine->cache[i] = value;
+	engine->cache_valid |= 1 << i;
+	engine->cache_misses++;
+}
+
+/*
+ * The engine now holds state, whatever fbcon last wrote is no longer there.
+ */
+static void
+chrome_engine_cache_set(struct chrome_info *info, u32 *state)
+{
+	struct chrome_engine *engine = &info->engine;
+
+	memcpy(engine->cache, state, sizeof(engine->cache));
+	engine->cache_valid = (1 << CHROME_ENGINE_STATE_REGS) - 1;
+}
+
+/*
+ * Mode set: layout and colours all change.
+ */
+void
+chrome_engine_invalidate(struct chrome_info *info)
+{
+	info->engine.cache_valid = 0;
+}
+
+/*
+ * GEMODE up to MONOPAT1, GECMD itself is never saved as writing it kicks
+ * off an operation.
+ */
+static void
+chrome_engine_save(struct chrome_info *info, int owner)
+{
+	u32 *state = info->engine.state[owner];
+	int i;
+
+	for (i = 0; i < CHROME_ENGINE_STATE_REGS; i++)
+		state[i] = chrome_mmio_read(info, CHROME_GE_GEMODE + 4 * i);
+}
+
+static void
+chrome_engine_restore(struct chrome_info *info, int owner)
+{
+	u32 *state = info->engine.state[owner];
+	int i;
+
+	for (i = 0; i < CHROME_ENGINE_STATE_REGS; i++)
+		chrome_mmio_write(info, CHROME_GE_GEMODE + 4 * i, state[i]);
+}
+
+/*
+ * Called with the engine lock held.
+ */
+static void
+chrome_engine_handover(struct chrome_info *info, int owner)
+{
+	struct chrome_engine *engine = &info->engine;
+
+	if (engine->pending) {
+		chrome_engine_idle(info);
+		engine->pending = 0;
+		engine->syncs++;
+	}
+
+	chrome_engine_save(info, engine->owner);
+	chrome_engine_restore(info, owner);
+	if (owner == CHROME_ENGINE_FBCON)
+		chrome_engine_cache_set(info, engine->state[owner]);
+
+	engine->owner = owner;
+	engine->handovers++;
+}
+
+/*
+ * Get the engine for kernel side use. Fails when a userspace client holds
+ * it; callers then fall back to the cpu. On success, the engine lock stays
+ * held until chrome_engine_release(), so that the whole operation, cache
+ * and accounting included, happens before anyone else gets the engine.
+ */
+int
+chrome_engine_acquire(struct chrome_info *info, int owner,
+		      unsigned long *flags)
+{
+	struct chrome_engine *engine = &info->engine;
+
+	spin_lock_irqsave(&engine->lock, *flags);
+
+	engine->acquires++;
+
+	if (likely(engine->owner == owner))
+		return 0;
+
+	if (engine->holder) {
+		engine->contended++;
+		spin_unlock_irqrestore(&engine->lock, *flags);
+		return -EBUSY;
+	}
+
+	chrome_engine_handover(info, owner);
+
+	return 0;
+}
+
+void
+chrome_engine_release(struct chrome_info *info, unsigned long flags)
+{
+	spin_unlock_irqrestore(&info->engine.lock, flags);
+}
+
+/*
+ * Userspace takes the engine: CHROMEFB_IOC_ENGINE_LOCK.
+ */
+int
+chrome_engine_lock(struct chrome_info *info, int tgid)
+{
+	struct chrome_engine *engine = &info->engine;
+	unsigned long flags;
+
+	spin_lock_irqsave(&engine->lock, flags);
+
+	engine->acquires++;
+
+	if (engine->holder && (engine->holder != tgid)) {
+		engine->contended++;
+		spin_unlock_irqrestore(&engine->lock, flags);
+		return -EBUSY;
+	}
+
+	if (engine->owner != CHROME_ENGINE_USER)
+		chrome_engine_handover(info, CHROME_ENGINE_USER);
+	engine->holder = tgid;
+
+	/* we have no idea what userspace does with it */
+	engine->pending = 1;
+
+	spin_unlock_irqrestore(&engine->lock, flags);
+	return 0;
+}
+
+/*
+ * CHROMEFB_IOC_ENGINE_UNLOCK, or with tgid 0, the last userspace client
+ * closing the device, whoever held it. The state stays with the engine
+ * until the next owner comes along.
+ */
+void
+chrome_engine_unlock(struct chrome_info *info, int tgid)
+{
+	struct chrome_engine *engine = &info->engine;
+	unsigned long flags;
+
+	spin_lock_irqsave(&engine->lock, flags);
+	if (!tgid || (engine->holder == tgid))
+		engine->holder = 0;
+	spin_unlock_irqrestore(&engine->lock, flags);
+}
+
+/*
+ * The cpu is about to touch the framebuffer: make sure that our own
+ * engine operations have landed first.
+ */
+static void
+chrome_engine_drain(struct chrome_info *info)
+{
+	struct chrome_engine *engine = &info->engine;
+
+	if (engine->pending && (engine->owner == CHROME_ENGINE_FBCON)) {
+		chrome_engine_idle(info);
+		engine->pending = 0;
+		engine->syncs++;
+	}
+}
+
+void
+chrome_engine_cpu(struct chrome_info *info)
+{
+	struct chrome_engine *engine = &info->engine;
+	unsigned long flags;
+
+	spin_lock_irqsave(&engine->lock, flags);
+	chrome_engine_drain(info);
+	spin_unlock_irqrestore(&engine->lock, flags);
+}
+
+/* sync spin bounds, and when to give up on the engine */
+#define CHROME_ENGINE_SPIN_MIN_NS   2000
+#define CHROME_ENGINE_SPIN_MAX_NS   1000000
+#define CHROME_ENGINE_TIMEOUT_NS    1000000000
+
+/*
+ * Has operation seq landed? Looks at the engine when we do not know yet.
+ */
+static int
+chrome_engine_done(struct chrome_info *info, u32 seq)
+{
+	struct chrome_engine *engine = &info->engine;
+	unsigned long flags;
+	int done = 0, wake = 0;
+
+	spin_lock_irqsave(&engine->lock, flags);
+
+	if (!engine->pending || ((s32) (engine->seq_done - seq) >= 0))
+		done = 1;
+	else if (!(chrome_mmio_read(info, CHROME_GE_STATUS) &
+		   info->chip->engine_busy)) {
+		engine->seq_done = engine->seq_queued;
+		engine->pending = 0;
+		done = 1;
+		wake = 1;
+	}
+
+	spin_unlock_irqrestore(&engine->lock, flags);
+
+	if (wake)
+		wake_up(&engine->wait);
+
+	return done;
+}
+
+/*
+ * Spin for twice the average wait, unless waits are too long to be worth
+ * spinning for at all. A sync that slept only knows that the engine was
+ * still busy when it stopped spinning, not when it went idle, so it hands
+ * in how long it spun rather than the time it overslept its jiffy.
+ */
+static void
+chrome_engine_spin_adapt(struct chrome_engine *engine, u32 waited)
+{
+	engine->wait_avg_ns = (7 * (u64) engine->wait_avg_ns + waited) >> 3;
+
+	if (engine->wait_avg_ns > (CHROME_ENGINE_SPIN_MAX_NS / 2))
+		engine->spin_ns = CHROME_ENGINE_SPIN_MIN_NS;
+	else if ((2 * engine->wait_avg_ns) < CHROME_ENGINE_SPIN_MIN_NS)
+		engine->spin_ns = CHROME_ENGINE_SPIN_MIN_NS;
+	else
+		engine->spin_ns = 2 * engine->wait_avg_ns;
+}
+
+/*
+ * Wait for the engine. Callers say whether they may sleep: in_atomic()
+ * cannot tell a spinlock holder without CONFIG_PREEMPT, so fb_sync, which
+ * fbcon can call from atomic context, only ever spins.
+ */
+int
+chrome_engine_sync(struct chrome_info *info, int sleep)
+{
+	struct chrome_engine *engine = &info->engine;
+	unsigned long flags;
+	u64 start, elapsed = 0, spun = 0;
+	u32 seq, waited;
+	int slept = 0, ret = 0;
+
+	spin_lock_irqsave(&engine->lock, flags);
+	if (!engine->pending) {
+		spin_unlock_irqrestore(&engine->lock, flags);
+		return 0;
+	}
+	seq = engine->seq_queued;
+	spin_unlock_irqrestore(&engine->lock, flags);
+
+	start = chrome_time_ns();
+
+	while (!chrome_engine_done(info, seq)) {
+		elapsed = chrome_time_ns() - start;
+
+		if (elapsed > CHROME_ENGINE_TIMEOUT_NS) {
+			printk(KERN_ERR "%s: 2D engine hangs (0x%08X).\n",
+			       __func__,
+			       chrome_mmio_read(info, CHROME_GE_STATUS));
+
+			spin_lock_irqsave(&engine->lock, flags);
+			engine->pending = 0;
+			engine->cache_valid = 0;
+			spin_unlock_irqrestore(&engine->lock, flags);
+
+			ret = -EBUSY;
+			break;
+		}
+
+		if (!sleep || (elapsed < engine->spin_ns)) {
+			cpu_relax();
+			continue;
+		}
+
+		if (!slept) {
+			spun = elapsed;
+			slept = 1;
+		}
+		wait_event_timeout(engine->wait, chrome_engine_done(info, seq),
+				   1);
+	}
+
+	elapsed = chrome_time_ns() - start;
+	if (elapsed > 0xFFFFFFFF)
+		waited = 0xFFFFFFFF;
+	else
+		waited = elapsed;
+
+	spin_lock_irqsave(&engine->lock, flags);
+
+	if (!ret)
+		chrome_engine_spin_adapt(engine, slept ? spun : waited);
+
+	engine->syncs++;
+	if (slept)
+		engine->sync_sleeps++;
+	else
+		engine->sync_spins++;
+	engine->sync_wait_us += waited / 1000;
+
+	spin_unlock_irqrestore(&engine->lock, flags);
+
+	return ret;
+}
+
+/*
+ *
+ */
+void
+chrome_accel_init(struct chrome_info *info)
+{
+	struct chrome_engine *engine = &info->engine;
+	int i;
+
+	DBG(__func__);
+
+	spin_lock_init(&engine->lock);
+	engine->owner = CHROME_ENGINE_FBCON;
+	engine->holder = 0;
+	engine->pending = 0;
+
+	init_waitqueue_head(&engine->wait);
+	engine->seq_queued = 0;
+	engine->seq_done = 0;
+	engine->spin_ns = CHROME_ENGINE_SPIN_MIN_NS;
+	engine->wait_avg_ns = 0;
+
+	if (!info->accel)
+		return;
+
+	chrome_engine_idle(info);
+
+	/* Start out with a clean slate. */
+	for (i = 0; i < CHROME_ENGINE_STATE_REGS; i++)
+		chrome_mmio_write(info, CHROME_GE_GEMODE + 4 * i, 0);
+
+	memset(engine->state, 0, sizeof(engine->state));
+	chrome_engine_cache_set(info, engine->state[CHROME_ENGINE_FBCON]);
+
+	chrome_debugfs_u32(info, "engine_acquires", &engine->acquires);
+	chrome_debugfs_u32(info, "engine_handovers", &engine->handovers);
+	chrome_debugfs_u32(info, "engine_contended", &engine->contended);
+	chrome_debugfs_u32(info, "engine_syncs", &engine->syncs);
+	chrome_debugfs_u32(info, "engine_cache_hits", &engine->cache_hits);
+	chrome_debugfs_u32(info, "engine_cache_misses", &engine->cache_misses);
+	chrome_debugfs_u32(info, "engine_sync_spins", &engine->sync_spins);
+	chrome_debugfs_u32(info, "engine_sync_sleeps", &engine->sync_sleeps);
+	chrome_debugfs_u32(info, "engine_sync_wait_us", &engine->sync_wait_us);
+	chrome_debugfs_u32(info, "engine_spin_ns", &engine->spin_ns);
+}
+
+/*
+ * Run one operation on its own, and time it until the engine is idle.
+ */
+static u32
+chrome_engine_calibrate_op(struct chrome_info *info, u32 cmd, u32 src,
+			   u32 dst, u32 width, u32 height)
+{
+	u64 start, elapsed;
+
+	chrome_engine_write(info, CHROME_GE_SRCBASE, src >> 3);
+	chrome_engine_write(info, CHROME_GE_DSTBASE, dst >> 3);
+	chrome_engine_write(info, CHROME_GE_SRCPOS, 0);
+	chrome_engine_write(info, CHROME_GE_DSTPOS, 0);
+	chrome_engine_write(info, CHROME_GE_DIMENSION,
+			    ((height - 1) << 16) | (width - 1));
+
+	start = chrome_time_ns();
+	chrome_mmio_write(info, CHROME_GE_GECMD, cmd);
+	if (chrome_engine_idle(info))
+		return 0;
+	elapsed = chrome_time_ns() - start;
+
+	return (elapsed > 0xFFFFFFFF) ? 0xFFFFFFFF : elapsed;
+}
+
+/*
+ * From chrome_calibrate(): status read latency, and what fills and copies
+ * cost, over size bytes of unused VRAM at offset. Lines are 1kB, at 32bpp.
+ */
+void
+chrome_engine_calibrate(struct chrome_info *info, unsigned long offset,
+			unsigned long size)
+{
+	struct chrome_calibration *calib = &info->calib;
+	u32 fill = CHROME_GEC_BLT | CHROME_GEC_FIXCOLOR_PAT | CHROME_GEC_ROP(0xF0);
+	u32 copy = CHROME_GEC_BLT | CHROME_GEC_ROP(0xCC);
+	u32 lines = size >> 10, ns;
+	unsigned long flags;
+	u64 start;
+	int i;
+
+	/* what every sync poll costs */
+	start = chrome_time_ns();
+	for (i = 0; i < 64; i++)
+		chrome_mmio_read(info, CHROME_GE_STATUS);
+	calib->mmio_read_ns = (chrome_time_ns() - start) >> 6;
+
+	if (!info->accel ||
+	    chrome_engine_acquire(info, CHROME_ENGINE_FBCON, &flags))
+		return;
+
+	chrome_engine_drain(info);
+
+	chrome_engine_write(info, CHROME_GE_GEMODE, CHROME_GEM_32BPP);
+	chrome_engine_write(info, CHROME_GE_PITCH,
+			    CHROME_PITCH_ENABLE | (128 << 16) | 128);
+	chrome_engine_write(info, CHROME_GE_FGCOLOR, 0);
+
+	/* a single pixel is all setup and completion */
+	calib->engine_setup_ns =
+		chrome_engine_calibrate_op(info, fill, offset, offset, 1, 1);
+
+	ns = chrome_engine_calibrate_op(info, fill, offset, offset, 256, lines);
+	calib->engine_fill_mbps = chrome_calibrate_rate(size, ns);
+
+	/* top half onto the bottom half */
+	ns = chrome_engine_calibrate_op(info, copy, offset, offset + size / 2,
+					256, lines / 2);
+	calib->engine_copy_mbps = chrome_calibrate_rate(size / 2, ns);
+
+	chrome_engine_release(info, flags);
+}
+
+/*
+ * The engine loses everything over a suspend: keep the state of whoever
+ * has it, and put that back on resume.
+ */
+void
+chrome_engine_suspend(struct chrome_info *info)
+{
+	struct chrome_engine *engine = &info->engine;
+	unsigned long flags;
+
+	if (!info->accel)
+		return;
+
+	spin_lock_irqsave(&engine->lock, flags);
+
+	if (engine->pending) {
+		chrome_engine_idle(info);
+		engine->pending = 0;
+		engine->syncs++;
+	}
+
+	chrome_engine_save(info, engine->owner);
+	engine->cache_valid = 0;
+
+	spin_unlock_irqrestore(&engine->lock, flags);
+}
+
+void
+chrome_engine_resume(struct chrome_info *info)
+{
+	struct chrome_engine *engine = &info->engine;
+	unsigned long flags;
+
+	if (!info->accel)
+		return;
+
+	spin_lock_irqsave(&engine->lock, flags);
+
+	chrome_engine_idle(info);
+	chrome_engine_restore(info, engine->owner);
+	if (engine->owner == CHROME_ENGINE_FBCON)
+		chrome_engine_cache_set(info, engine->state[CHROME_ENGINE_FBCON]);
+
+	spin_unlock_irqrestore(&engine->lock, flags);
+}
+
+/*
+ * Back from a VT switch: the client that had the hardware might have used
+ * the engine without asking. Read back what it left into state, then put
+ * back, register by register, only what fbcon relies on. Returns the number
+ * of registers written.
+ */
+int
+chrome_engine_replay(struct chrome_info *info, u32 *state)
+{
+	struct chrome_engine *engine = &info->engine;
+	unsigned long flags;
+	int i, count = 0;
+
+	if (!info->accel)
+		return 0;
+
+	spin_lock_irqsave(&engine->lock, flags);
+
+	chrome_engine_idle(info);
+	engine->pending = 0;
+
+	for (i = 0; i < CHROME_ENGINE_STATE_REGS; i++)
+		state[i] = chrome_mmio_read(info, CHROME_GE_GEMODE + 4 * i);
+
+	/* a client that holds the engine keeps its state */
+	if (engine->owner == CHROME_ENGINE_FBCON) {
+		for (i = 0; i < CHROME_ENGINE_STATE_REGS; i++) {
+			if (!(engine->cache_valid & (1 << i))) {
+				/* nothing to put back, but now it is known */
+				engine->cache[i] = state[i];
+				engine->cache_valid |= 1 << i;
+			} else if (state[i] != engine->cache[i]) {
+				chrome_mmio_write(info, CHROME_GE_GEMODE + 4 * i,
+						  engine->cache[i]);
+				count++;
+			}
+		}
+	}
+
+	spin_unlock_irqrestore(&engine->lock, flags);
+
+	return count;
+}
+
+/*
+ * Mode and pitch for the current fb layout.
+ */
+static void
+chrome_accel_setup(struct chrome_info *info)
+{
+	struct fb_info *fb_info = &info->fb_info;
+	u32 pitch = fb_info->fix.line_length >> 3;
+
+	switch (fb_info->var.bits_per_pixel) {
+	case 8:
+		chrome_engine_write(info, CHROME_GE_GEMODE, CHROME_GEM_8BPP);
+		break;
+	case 16:
+		chrome_engine_write(info, CHROME_GE_GEMODE, CHROME_GEM_16BPP);
+		break;
+	default:
+		chrome_engine_write(info, CHROME_GE_GEMODE, CHROME_GEM_32BPP);
+		break;
+	}
+
+	chrome_engine_write(info, CHROME_GE_PITCH,
+			  CHROME_PITCH_ENABLE | (pitch << 16) | pitch);
+}
+
+/*
+ *
+ */
+void
+chrome_fillrect(struct fb_info *fb_info, const struct fb_fillrect *rect)
+{
+	struct chrome_info *info = (struct chrome_info *) fb_info;
+	u32 base = 0, y = rect->dy;
+	unsigned long flags;
+
+	if (!rect->width || !rect->height || !info->init_ready)
+		return;
+
+	if (info->shadow) {
+		sys_fillrect(fb_info, rect);
+		chrome_rotate_damage(info, rect->dx, rect->dy, rect->width,
+				     rect->height);
+		return;
+	}
+
+	if (!info->accel ||
+	    chrome_engine_acquire(info, CHROME_ENGINE_FBCON, &flags)) {
+		chrome_soft_fillrect(fb_info, rect);
+		return;
+	}
+
+	/* not worth setting up the engine for */
+	if (((rect->width * rect->height * fb_info->var.bits_per_pixel) >> 3) <
+	    info->calib.fill_min) {
+		chrome_engine_drain(info);
+		chrome_engine_release(info, flags);
+		chrome_soft_fillrect(fb_info, rect);
+		return;
+	}
+
+	if ((rect->dy + rect->height) > info->chip->engine_max_y) {
+		base = rect->dy * fb_info->fix.line_length;
+		y = 0;
+	}
+
+	chrome_accel_setup(info);
+
+	chrome_engine_write(info, CHROME_GE_DSTBASE, base >> 3);
+	chrome_engine_write(info, CHROME_GE_DSTPOS, (y << 16) | rect->dx);
+	chrome_engine_write(info, CHROME_GE_DIMENSION,
+			  ((rect->height - 1) << 16) | (rect->width - 1));
+	chrome_engine_write(info, CHROME_GE_FGCOLOR,
+			  chrome_colour(fb_info, rect->color));
+
+	/* PATCOPY or PATINVERT */
+	chrome_mmio_write(info, CHROME_GE_GECMD, CHROME_GEC_BLT |
+			  CHROME_GEC_FIXCOLOR_PAT |
+			  CHROME_GEC_ROP((rect->rop == ROP_XOR) ? 0x5A : 0xF0));
+
+	info->engine.seq_queued++;
+	info->engine.pending = 1;
+
+	chrome_engine_release(info, flags);
+}
+
+/*
+ *
+ */
+void
+chrome_copyarea(struct fb_info *fb_info, const struct fb_copyarea *area)
+{
+	struct chrome_info *info = (struct chrome_info *) fb_info;
+	u32 cmd = CHROME_GEC_BLT | CHROME_GEC_ROP(0xCC);
+	u32 sx = area->sx, sy = area->sy, dx = area->dx, dy = area->dy;
+	u32 src_base = 0, dst_base = 0;
+	unsigned long flags;
+
+	if (!area->width || !area->height || !info->init_ready)
+		return;
+
+	if (info->shadow) {
+		sys_copyarea(fb_info, area);
+		chrome_rotate_damage(info, area->dx, area->dy, area->width,
+				     area->height);
+		return;
+	}
+
+	if (!info->accel ||
+	    chrome_engine_acquire(info, CHROME_ENGINE_FBCON, &flags)) {
+		chrome_soft_copyarea(fb_info, area);
+		return;
+	}
+
+	if (((area->width * area->height * fb_info->var.bits_per_pixel) >> 3) <
+	    info->calib.copy_min) {
+		chrome_engine_drain(info);
+		chrome_engine_release(info, flags);
+		chrome_soft_copyarea(fb_info, area);
+		return;
+	}
+
+	/* rebase both rectangles when out of reach */
+	if (((sy + area->height) > info->chip->engine_max_y) ||
+	    ((dy + area->height) > info->chip->engine_max_y)) {
+		src_base = sy * fb_info->fix.line_length;
+		dst_base = dy * fb_info->fix.line_length;
+		sy = 0;
+		dy = 0;
+	}
+
+	/* overlap: work from the bottom and/or right */
+	if ((src_base + sy * fb_info->fix.line_length) <
+	    (dst_base + dy * fb_info->fix.line_length)) {
+		cmd |= CHROME_GEC_DECY;
+		sy += area->height - 1;
+		dy += area->height - 1;
+	}
+
+	if ((area->sy == area->dy) && (area->sx < area->dx)) {
+		cmd |= CHROME_GEC_DECX;
+		sx += area->width - 1;
+		dx += area->width - 1;
+	}
+
+	chrome_accel_setup(info);
+
+	chrome_engine_write(info, CHROME_GE_SRCBASE, src_base >> 3);
+	chrome_engine_write(info, CHROME_GE_DSTBASE, dst_base >> 3);
+	chrome_engine_write(info, CHROME_GE_SRCPOS, (sy << 16) | sx);
+	chrome_engine_write(info, CHROME_GE_DSTPOS, (dy << 16) | dx);
+	chrome_engine_write(info, CHROME_GE_DIMENSION,
+			  ((area->height - 1) << 16) | (area->width - 1));
+	chrome_mmio_write(info, CHROME_GE_GECMD, cmd);
+
+	info->engine.seq_queued++;
+	info->engine.pending = 1;
+
+	chrome_engine_release(info, flags);
+}
+
+/*
+ * No host data blits yet, so glyphs are drawn by the cpu. Make sure that
+ * preceding fills and copies have landed.
+ *
+ * fbcon can draw from atomic context, so none of the drawing ops wait for
+ * the deferred part of probe. Until then, textmode is still in VRAM, and
+ * fbcon redraws everything after its first set_par anyway.
+ */
+void
+chrome_imageblit(struct fb_info *fb_info, const struct fb_image *image)
+{
+	struct chrome_info *info = (struct chrome_info *) fb_info;
+
+	if (!info->init_ready)
+		return;
+
+	if (info->shadow) {
+		sys_imageblit(fb_info, image);
+		chrome_rotate_damage(info, image->dx, image->dy, image->width,
+				     image->height);
+		return;
+	}
+
+	chrome_engine_cpu(info);
+
+	chrome_soft_imageblit(fb_info, image);
+}
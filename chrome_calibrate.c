@@ -0,0 +1,195 @@
+/*
+ * chromefb: driver for VIAs UniChrome and Chrome IGP graphics.
+ *
+ * Copyright (c) 2007 by Luc Verhaegen (libv@skynet.be)
+ *
+ * This file is subject to the terms and conditions of the GNU General
+ * Public License.  See the file COPYING in the main directory of this
+ * archive for more details.
+ *
+ */
+/*
+ * Probe time calibration.
+ *
+ * How cpu writes, cpu reads and the 2D engine compare differs per board:
+ * K8M800 has a fast cpu path and a slow engine, on CLE266 uncached reads
+ * from VRAM crawl. So rather than guessing, the deferred part of probe
+ * measures them on the top of VRAM, which nothing scans out yet, and
+ * picks from that:
+ *   - whether fbcon gets told that reads are fast, so it scrolls by
+ *     moving instead of redrawing.
+ *   - below what size fills and copies are left to the cpu, as engine
+ *     setup and completion would cost more.
+ *   - whether the console draws into a shadow in system memory even when
+ *     not rotated: when reads are slow and the engine does not copy.
+ *
+ * All of it is in sysfs, on the pci device.
+ */
+
+#include <linux/kernel.h>
+#include <linux/fb.h>
+#include <linux/slab.h>
+#include <linux/string.h>
+#include <asm/io.h>
+#include <asm/div64.h>
+
+#include "chrome.h"
+
+#define CHROME_CALIBRATE_SIZE   (256 * 1024)
+#define CHROME_CALIBRATE_CHUNK  (64 * 1024)
+#define CHROME_CALIBRATE_RUNS   3
+
+/*
+ * MB/s.
+ */
+u32
+chrome_calibrate_rate(u32 bytes, u64 ns)
+{
+	u64 rate = (u64) bytes * 1000;
+
+	if (!ns)
+		return 0;
+	if (ns > 0xFFFFFFFF)
+		ns = 0xFFFFFFFF;
+
+	do_div(rate, (u32) ns);
+	return rate;
+}
+
+/*
+ * Best of a few runs: the first one pays for cache and TLB misses.
+ */
+static u32
+chrome_calibrate_cpu(struct chrome_info *info, void *buf, unsigned long offset,
+		     int write)
+{
+	u8 __iomem *fb = (u8 __iomem *) info->fbbase + offset;
+	u64 start, elapsed, best = ~0ULL;
+	unsigned long done;
+	int run;
+
+	for (run = 0; run < CHROME_CALIBRATE_RUNS; run++) {
+		start = chrome_time_ns();
+
+		for (done = 0; done < CHROME_CALIBRATE_SIZE;
+		     done += CHROME_CALIBRATE_CHUNK) {
+			if (write)
+				memcpy_toio(fb + done, buf,
+					    CHROME_CALIBRATE_CHUNK);
+			else
+				memcpy_fromio(buf, fb + done,
+					      CHROME_CALIBRATE_CHUNK);
+		}
+
+		/* posted writes have to land too */
+		if (write)
+			readl(fb);
+
+		elapsed = chrome_time_ns() - start;
+		if (elapsed < best)
+			best = elapsed;
+	}
+
+	return chrome_calibrate_rate(CHROME_CALIBRATE_SIZE, best);
+}
+
+/*
+ * Below how many bytes the cpu beats the engine, ~0 when it always does:
+ * engine setup + bytes / engine < bytes / cpu.
+ */
+static u32
+chrome_calibrate_min(u32 setup_ns, u32 cpu, u32 engine)
+{
+	u64 min;
+
+	if (!engine || !cpu)
+		return 0;
+	if (engine <= cpu)
+		return ~0;
+
+	min = (u64) setup_ns * cpu * engine;
+	do_div(min, 1000 * (engine - cpu));
+
+	return (min > 0xFFFFFFFE) ? 0xFFFFFFFE : min;
+}
+
+/*
+ *
+ */
+static void
+chrome_calibrate_pick(struct chrome_info *info)
+{
+	struct chrome_calibration *calib = &info->calib;
+	u64 cpu_copy = 0;
+
+	/* a read and a write per byte */
+	if (calib->cpu_read_mbps + calib->cpu_write_mbps) {
+		cpu_copy = (u64) calib->cpu_read_mbps * calib->cpu_write_mbps;
+		do_div(cpu_copy, calib->cpu_read_mbps + calib->cpu_write_mbps);
+	}
+
+	calib->fill_min = chrome_calibrate_min(calib->engine_setup_ns,
+					       calib->cpu_write_mbps,
+					       calib->engine_fill_mbps);
+	calib->copy_min = chrome_calibrate_min(calib->engine_setup_ns, cpu_copy,
+					       calib->engine_copy_mbps);
+
+	calib->reads_fast = (2 * calib->cpu_read_mbps) >= calib->cpu_write_mbps;
+
+	calib->shadow = !calib->reads_fast &&
+		(!info->accel || (calib->copy_min == ~0));
+}
+
+/*
+ * From the init worker, after textmode is stored and before the first
+ * modeset. Skipped when the firmware mode reaches the top of VRAM.
+ */
+void
+chrome_calibrate(struct chrome_info *info)
+{
+	struct chrome_calibration *calib = &info->calib;
+	struct fb_var_screeninfo *mode = &info->mode_firmware;
+	unsigned long offset, end;
+	__u32 pitch;
+	void *buf;
+
+	memset(calib, 0, sizeof(struct chrome_calibration));
+
+	if ((info->fbsize * 1024) < (4 * CHROME_CALIBRATE_SIZE))
+		return;
+	offset = info->fbsize * 1024 - CHROME_CALIBRATE_SIZE;
+
+	if (info->mode_adopted) {
+		pitch = ((mode->xres_virtual * ((mode->bits_per_pixel + 7) >> 3))
+			 + 31) & ~31;
+		end = 2 * chrome_mode_start(mode, pitch) + pitch * mode->yres;
+		if (end > offset) {
+			CHROME_DEBUG("%s: VRAM is in use, skipped.\n", __func__);
+			return;
+		}
+	}
+
+	buf = kmalloc(CHROME_CALIBRATE_CHUNK, GFP_KERNEL);
+	if (!buf)
+		return;
+	memset(buf, 0, CHROME_CALIBRATE_CHUNK);
+
+	calib->cpu_write_mbps = chrome_calibrate_cpu(info, buf, offset, 1);
+	calib->cpu_read_mbps = chrome_calibrate_cpu(info, buf, offset, 0);
+
+	kfree(buf);
+
+	chrome_engine_calibrate(info, offset, CHROME_CALIBRATE_SIZE);
+
+	chrome_calibrate_pick(info);
+	calib->done = 1;
+
+	printk(KERN_INFO "chromefb: cpu writes %uMB/s, reads %uMB/s; mmio "
+	       "reads %uns; engine fills %uMB/s, copies %uMB/s, %uns setup.\n",
+	       calib->cpu_write_mbps, calib->cpu_read_mbps, calib->mmio_read_ns,
+	       calib->engine_fill_mbps, calib->engine_copy_mbps,
+	       calib->engine_setup_ns);
+	CHROME_DEBUG("chromefb: fill_min %u, copy_min %u, reads_fast %d, "
+		     "shadow %d.\n", calib->fill_min, calib->copy_min,
+		     calib->reads_fast, calib->shadow);
+}
@@ -0,0 +1,170 @@
+/*
+ * chromefb: driver for VIAs UniChrome and Chrome IGP graphics.
+ *
+ * Copyright (c) 2006-2007 by Luc Verhaegen (libv@skynet.be)
+ *
+ * This file is subject to the terms and conditions of the GNU General
+ * Public License.  See the file COPYING in the main directory of this
+ * archive for more details.
+ *
+ */
+/*
+ * Everything that differs between the supported chips, in one table.
+ *
+ * The entry is picked once at probe time, after that nothing needs to look
+ * at the PCI id again. Adding a chip means adding an entry here.
+ */
+
+#include <linux/kernel.h>
+#include <linux/fb.h>
+#include <linux/pci.h>
+
+#include "chrome.h"
+#include "chrome_io.h"
+#include "chrome_pll.h"
+
+/*
+ *
+ * PLL registers.
+ *
+ */
+static void
+vt3122_pll_set(struct chrome_info *info, __u32 pll)
+{
+	chrome_vga_seq_write(info, 0x46, pll >> 8);
+	chrome_vga_seq_write(info, 0x47, pll & 0xFF);
+}
+
+static __u32
+vt3122_pll_get(struct chrome_info *info)
+{
+	return (chrome_vga_seq_read(info, 0x46) << 8) |
+		chrome_vga_seq_read(info, 0x47);
+}
+
+static void
+vt3108_pll_set(struct chrome_info *info, __u32 pll)
+{
+	chrome_vga_seq_write(info, 0x44, pll >> 16);
+	chrome_vga_seq_write(info, 0x45, (pll >> 8) & 0xFF);
+	chrome_vga_seq_write(info, 0x46, pll & 0xFF);
+}
+
+static __u32
+vt3108_pll_get(struct chrome_info *info)
+{
+	return (chrome_vga_seq_read(info, 0x44) << 16) |
+		(chrome_vga_seq_read(info, 0x45) << 8) |
+		chrome_vga_seq_read(info, 0x46);
+}
+
+/*
+ *
+ * Display FIFO depth and thresholds. As with everything here, these are
+ * for the primary only.
+ *
+ */
+static void
+vt3122_fifo(struct chrome_mode_regs *regs, struct fb_var_screeninfo *mode)
+{
+	chrome_reg_sr(regs, 0x16, 0x0C, 0xBF); /* threshold */
+	chrome_reg_sr(regs, 0x17, 0x1F, 0xFF); /* depth */
+	chrome_reg_sr(regs, 0x18, 0x4E, 0xFF); /* high threshold */
+	chrome_reg_sr(regs, 0x22, 0x1F, 0x1F); /* request expire */
+}
+
+static void
+vt7205_fifo(struct chrome_mode_regs *regs, struct fb_var_screeninfo *mode)
+{
+	if (mode->xres >= 1600) {
+		chrome_reg_sr(regs, 0x16, 0x09, 0x3F);
+		chrome_reg_sr(regs, 0x17, 0x1C, 0xFF);
+	} else {
+		chrome_reg_sr(regs, 0x16, 0x0E, 0x3F);
+		chrome_reg_sr(regs, 0x17, 0x1F, 0xFF);
+	}
+	chrome_reg_sr(regs, 0x18, 0x4E, 0xFF);
+	chrome_reg_sr(regs, 0x22, 0x1F, 0x1F);
+}
+
+static void
+vt3108_fifo(struct chrome_mode_regs *regs, struct fb_var_screeninfo *mode)
+{
+	chrome_reg_sr(regs, 0x16, 0x92, 0xBF);
+	chrome_reg_sr(regs, 0x17, 0xBF, 0xFF);
+	chrome_reg_sr(regs, 0x18, 0x8A, 0xBF);
+	if ((mode->xres >= 1400) && (mode->bits_per_pixel == 32))
+		chrome_reg_sr(regs, 0x22, 0x10, 0x1F);
+	else
+		chrome_reg_sr(regs, 0x22, 0x00, 0x1F);
+}
+
+/*
+ *
+ */
+static const struct chrome_chip chrome_chips[] = {
+	{
+		.id = PCI_CHIP_VT3122,
+		.name = "VT3122 (CastleRock)",
+		.caps = CHROME_CAP_ACCEL,
+		.pan_max = 0x1FFFFFF,
+		.pitch_max = 16368,
+		.fetch_max = 16376,
+		.pll_generate = vt3122_pll_generate,
+		.pll_clock = vt3122_pll_clock,
+		.pll_set = vt3122_pll_set,
+		.pll_get = vt3122_pll_get,
+		.fifo = vt3122_fifo,
+		.engine_busy = CHROME_STATUS_BUSY,
+		.engine_max_y = 2048, /* positions are 11bits */
+	},
+	{
+		.id = PCI_CHIP_VT7205,
+		.name = "VT7205 (UniChrome)",
+		.caps = CHROME_CAP_ACCEL,
+		.pan_max = 0x7FFFFFF, /* equals MAX FB size */
+		.pitch_max = 16368,
+		.fetch_max = 16376,
+		.pll_generate = vt3122_pll_generate,
+		.pll_clock = vt3122_pll_clock,
+		.pll_set = vt3122_pll_set,
+		.pll_get = vt3122_pll_get,
+		.fifo = vt7205_fifo,
+		.engine_busy = CHROME_STATUS_BUSY,
+		.engine_max_y = 2048, /* positions are 11bits */
+	},
+	{
+		.id = PCI_CHIP_VT3108,
+		.name = "VT3108 (UniChrome Pro)",
+		.caps = CHROME_CAP_ACCEL | CHROME_CAP_SCALER_FINE,
+		.pan_max = 0x7FFFFFF,
+		.pitch_max = 16368,
+		.fetch_max = 16376,
+		.pll_generate = vt3108_pll_generate,
+		.pll_clock = vt3108_pll_clock,
+		.pll_set = vt3108_pll_set,
+		.pll_get = vt3108_pll_get,
+		.fifo = vt3108_fifo,
+		.engine_busy = CHROME_STATUS_BUSY,
+		.engine_max_y = 2048, /* positions are 11bits */
+	},
+	{ .id = 0 }
+};
+
+/*
+ * Called from probe, before anything touches the hardware.
+ */
+int
+chrome_chip_select(struct chrome_info *info)
+{
+	int i;
+
+	for (i = 0; chrome_chips[i].id; i++)
+		if (chrome_chips[i].id == info->id) {
+			info->chip = &chrome_chips[i];
+			return 0;
+		}
+
+	printk(KERN_ERR "%s: unsupported chip: 0x%04X\n", __func__, info->id);
+	return -ENODEV;
+}
@@ -0,0 +1,248 @@
+/*
+ * chromefb: driver for VIAs UniChrome and Chrome IGP graphics.
+ *
+ * Copyright (c) 2007 by Luc Verhaegen (libv@skynet.be)
+ *
+ * This file is subject to the terms and conditions of the GNU General
+ * Public License.  See the file COPYING in the main directory of this
+ * archive for more details.
+ *
+ */
+/*
+ * read() and write() on the device, and region capture.
+ *
+ * The generic fbdev paths move the framebuffer a long at a time. Here,
+ * everything goes through a bounce buffer in big memcpy_fromio() and
+ * memcpy_toio() chunks instead. The 2D engine cannot write to system
+ * memory, and there is no documented bus master that can, so the cpu does
+ * the moving either way.
+ *
+ * With a rotation shadow, the framebuffer that userspace sees is the
+ * shadow in system memory, and writes get rotated out as damage.
+ */
+
+#include <linux/kernel.h>
+#include <linux/fb.h>
+#include <linux/slab.h>
+#include <asm/uaccess.h>
+
+#include "chrome.h"
+#include "chrome_ioctl.h"
+
+#define CHROME_COPY_BOUNCE (64 * 1024)
+
+/*
+ * A big bounce buffer if we can get it, a page otherwise.
+ */
+static void *
+chrome_copy_bounce(size_t *size)
+{
+	void *bounce;
+
+	*size = CHROME_COPY_BOUNCE;
+	bounce = kmalloc(*size, GFP_KERNEL | __GFP_NOWARN);
+	if (bounce)
+		return bounce;
+
+	*size = PAGE_SIZE;
+	return kmalloc(*size, GFP_KERNEL);
+}
+
+/*
+ * Framebuffer offset to userspace, in bounce sized chunks.
+ */
+static int
+chrome_copy_from_fb(struct chrome_info *info, char __user *buf,
+		    unsigned long offset, size_t count, void *bounce,
+		    size_t size)
+{
+	size_t chunk;
+
+	if (info->shadow)
+		return copy_to_user(buf, info->shadow + offset, count) ?
+			-EFAULT : 0;
+
+	while (count) {
+		chunk = min(count, size);
+
+		memcpy_fromio(bounce, info->fbbase + offset, chunk);
+		if (copy_to_user(buf, bounce, chunk))
+			return -EFAULT;
+
+		buf += chunk;
+		offset += chunk;
+		count -= chunk;
+	}
+
+	return 0;
+}
+
+/*
+ * Before the cpu reads or writes the scanout, the engine needs to be done.
+ */
+static unsigned long
+chrome_copy_prepare(struct chrome_info *info)
+{
+	struct fb_info *fb_info = &info->fb_info;
+	unsigned long total = fb_info->fix.smem_len;
+
+	chrome_init_wait(info);
+
+	if (fb_info->screen_size)
+		total = fb_info->screen_size;
+
+	if (!info->shadow)
+		chrome_engine_sync(info, 1);
+
+	return total;
+}
+
+/*
+ * fb_read.
+ */
+ssize_t
+chrome_fb_read(struct fb_info *fb_info, char __user *buf, size_t count,
+	       loff_t *ppos)
+{
+	struct chrome_info *info = (struct chrome_info *) fb_info;
+	unsigned long p = *ppos, total;
+	size_t size;
+	void *bounce;
+	int ret;
+
+	total = chrome_copy_prepare(info);
+	if (p >= total)
+		return 0;
+	if (count > (total - p))
+		count = total - p;
+	if (!count)
+		return 0;
+
+	bounce = chrome_copy_bounce(&size);
+	if (!bounce)
+		return -ENOMEM;
+
+	ret = chrome_copy_from_fb(info, buf, p, count, bounce, size);
+
+	kfree(bounce);
+
+	if (ret)
+		return ret;
+
+	*ppos += count;
+	return count;
+}
+
+/*
+ * fb_write.
+ */
+ssize_t
+chrome_fb_write(struct fb_info *fb_info, const char __user *buf, size_t count,
+		loff_t *ppos)
+{
+	struct chrome_info *info = (struct chrome_info *) fb_info;
+	unsigned long p = *ppos, total, offset;
+	size_t size, chunk, done = 0;
+	void *bounce;
+	int ret = 0;
+
+	total = chrome_copy_prepare(info);
+	if (p > total)
+		return -EFBIG;
+	if (count > (total - p)) {
+		count = total - p;
+		ret = -ENOSPC;
+	}
+
+	if (info->shadow) {
+		if (copy_from_user(info->shadow + p, buf, count))
+			ret = -EFAULT;
+		else
+			done = count;
+	} else if (count) {
+		bounce = chrome_copy_bounce(&size);
+		if (!bounce)
+			return -ENOMEM;
+
+		for (offset = p; done < count; done += chunk, offset += chunk) {
+			chunk = min(count - done, size);
+
+			if (copy_from_user(bounce, buf + done, chunk)) {
+				ret = -EFAULT;
+				break;
+			}
+			memcpy_toio(info->fbbase + offset, bounce, chunk);
+		}
+
+		kfree(bounce);
+	}
+
+	/* whole lines: the rotation works on rectangles */
+	if (info->shadow && done)
+		chrome_rotate_damage(info, 0, p / fb_info->fix.line_length,
+				     fb_info->var.xres,
+				     (p + done - 1) / fb_info->fix.line_length -
+				     p / fb_info->fix.line_length + 1);
+
+	*ppos += done;
+	return done ? done : ret;
+}
+
+/*
+ * CHROMEFB_IOC_CAPTURE: a rectangle, line by line, in framebuffer layout.
+ */
+int
+chrome_capture(struct chrome_info *info, struct chromefb_capture *capture)
+{
+	struct fb_info *fb_info = &info->fb_info;
+	struct fb_var_screeninfo *mode = &fb_info->var;
+	char __user *buf = (char __user *) (unsigned long) capture->buffer;
+	unsigned long offset;
+	__u32 bytes_per_pixel, line, pitch, i;
+	size_t size;
+	void *bounce;
+	int ret = 0;
+
+	if (!capture->width || !capture->height ||
+	    (capture->width > mode->xres_virtual) ||
+	    (capture->height > mode->yres_virtual) ||
+	    (capture->x > (mode->xres_virtual - capture->width)) ||
+	    (capture->y > (mode->yres_virtual - capture->height)))
+		return -EINVAL;
+
+	if (mode->bits_per_pixel < 24)
+		bytes_per_pixel = mode->bits_per_pixel >> 3;
+	else
+		bytes_per_pixel = 4;
+
+	line = capture->width * bytes_per_pixel;
+	pitch = capture->pitch ? capture->pitch : line;
+	if (pitch < line)
+		return -EINVAL;
+
+	if (!access_ok(VERIFY_WRITE, buf,
+		       (capture->height - 1) * (unsigned long) pitch + line))
+		return -EFAULT;
+
+	chrome_copy_prepare(info);
+
+	bounce = chrome_copy_bounce(&size);
+	if (!bounce)
+		return -ENOMEM;
+
+	offset = capture->y * fb_info->fix.line_length +
+		capture->x * bytes_per_pixel;
+
+	for (i = 0; i < capture->height; i++) {
+		ret = chrome_copy_from_fb(info, buf, offset, line, bounce, size);
+		if (ret)
+			break;
+
+		buf += pitch;
+		offset += fb_info->fix.line_length;
+	}
+
+	kfree(bounce);
+
+	return ret;
+}
@@ -0,0 +1,119 @@
+/*
+ * chromefb: driver for VIAs UniChrome and Chrome IGP graphics.
+ *
+ * Copyright (c) 2007 by Luc Verhaegen (libv@skynet.be)
+ *
+ * This file is subject to the terms and conditions of the GNU General
+ * Public License.  See the file COPYING in the main directory of this
+ * archive for more details.
+ *
+ */
+/*
+ * Statistics and other debugging aids, under debugfs/chromefb/<pci id>/.
+ *
+ * Everything is optional here: when debugfs is not there, or when we run
+ * out of slots, the driver works on regardless.
+ */
+
+#include <linux/fb.h>
+#include <linux/pci.h>
+#include <linux/debugfs.h>
+
+#include "chrome.h"
+
+static struct dentry *chrome_debugfs_root;
+static int chrome_debugfs_users;
+
+/*
+ *
+ */
+void
+chrome_debugfs_init(struct chrome_info *info)
+{
+	DBG(__func__);
+
+	if (!chrome_debugfs_root) {
+		chrome_debugfs_root = debugfs_create_dir(DRIVER_NAME, NULL);
+		if (!chrome_debugfs_root)
+			return;
+	}
+	chrome_debugfs_users++;
+
+	info->debugfs_dir = debugfs_create_dir(pci_name(info->pci_dev),
+					       chrome_debugfs_root);
+}
+
+/*
+ * Keep track of everything we create, there is no recursive removal.
+ */
+static void
+chrome_debugfs_add(struct chrome_info *info, struct dentry *file)
+{
+	if (!file)
+		return;
+
+	if (info->debugfs_count >= CHROME_DEBUGFS_FILES) {
+		printk(KERN_WARNING "%s: out of debugfs slots.\n", __func__);
+		debugfs_remove(file);
+		return;
+	}
+
+	info->debugfs_files[info->debugfs_count++] = file;
+}
+
+void
+chrome_debugfs_u32(struct chrome_info *info, const char *name, u32 *value)
+{
+	if (!info->debugfs_dir)
+		return;
+
+	chrome_debugfs_add(info, debugfs_create_u32(name, S_IRUGO,
+						    info->debugfs_dir, value));
+}
+
+/*
+ * A switch, for userspace to flip.
+ */
+void
+chrome_debugfs_bool(struct chrome_info *info, const char *name, u32 *value)
+{
+	if (!info->debugfs_dir)
+		return;
+
+	chrome_debugfs_add(info, debugfs_create_bool(name, S_IRUGO | S_IWUSR,
+						     info->debugfs_dir, value));
+}
+
+void
+chrome_debugfs_file(struct chrome_info *info, const char *name, int mode,
+		    void *data, const struct file_operations *fops)
+{
+	if (!info->debugfs_dir)
+		return;
+
+	chrome_debugfs_add(info, debugfs_create_file(name, mode,
+						     info->debugfs_dir, data,
+						     fops));
+}
+
+/*
+ *
+ */
+void
+chrome_debugfs_exit(struct chrome_info *info)
+{
+	DBG(__func__);
+
+	while (info->debugfs_count)
+		debugfs_remove(info->debugfs_files[--info->debugfs_count]);
+
+	if (info->debugfs_dir) {
+		debugfs_remove(info->debugfs_dir);
+		info->debugfs_dir = NULL;
+	}
+
+	if (chrome_debugfs_root && !--chrome_debugfs_users) {
+		debugfs_remove(chrome_debugfs_root);
+		chrome_debugfs_root = NULL;
+	}
+}
@@ -21,9 +21,26 @@
 #include <linux/kernel.h>
 #include <linux/fb.h>
 #include <linux/pci.h>
+#include <linux/sched.h>
+#include <linux/workqueue.h>
+#include <linux/completion.h>
+#include <linux/vmalloc.h>
+#include <asm/uaccess.h>
+#ifdef CONFIG_MTRR
+#include <asm/mtrr.h>
+#endif
 
 #include "chrome.h"
 #include "chrome_io.h"
+#include "chrome_ioctl.h"
+#include "chrome_trace.h"
+
+static int noaccel;
+static int nodirect;
+int chrome_debug;
+static int async_probe = 1;
+static char *mode_option;
+static char *output_option;
 
 /*
  *
@@ -31,6 +48,205 @@
  *
  */
 
+/*
+ * The linear FB holds the VGA planes interleaved per byte: plane n of VGA
+ * address a is at 4 * a + n. Copies go through a small bounce buffer, so
+ * that the FB sees wide accesses only.
+ */
+#define CHROME_TEXT_BOUNCE 256
+
+/*
+ * Plane run length encoding: a control byte below 0x80 is followed by that
+ * many plus one literal bytes, one from 0x80 on repeats the byte after it
+ * (control - 0x80 + 3) times. Blank text and empty glyph rows fold down to
+ * next to nothing.
+ */
+#define CHROME_RLE_REPEAT_MIN  3
+#define CHROME_RLE_REPEAT_MAX  (0x7F + CHROME_RLE_REPEAT_MIN)
+#define CHROME_RLE_INITIAL    PAGE_SIZE
+
+/*
+ * The encoder is fed a byte at a time, so that a plane never has to sit
+ * around raw. Its output grows as needed and stays compressed.
+ */
+struct chrome_rle_encoder {
+	unsigned char *out;
+	int size, used;
+	int literal, run;
+	unsigned char value;
+};
+
+static void
+chrome_rle_put(struct chrome_rle_encoder *rle, unsigned char byte)
+{
+	unsigned char *out;
+
+	if (!rle->out)
+		return;
+
+	if (rle->used == rle->size) {
+		out = vmalloc(2 * rle->size);
+		if (out)
+			memcpy(out, rle->out, rle->used);
+		vfree(rle->out);
+		rle->out = out;
+		rle->size *= 2;
+		if (!out)
+			return;
+	}
+
+	rle->out[rle->used++] = byte;
+}
+
+/*
+ * Emit the pending run: a repeat when it is long enough, literals otherwise.
+ */
+static void
+chrome_rle_flush(struct chrome_rle_encoder *rle)
+{
+	if (rle->run >= CHROME_RLE_REPEAT_MIN) {
+		chrome_rle_put(rle, 0x80 + rle->run - CHROME_RLE_REPEAT_MIN);
+		chrome_rle_put(rle, rle->value);
+		rle->literal = -1;
+	} else {
+		for (; rle->run; rle->run--) {
+			if ((rle->literal < 0) || !rle->out ||
+			    (rle->out[rle->literal] == 0x7F)) {
+				rle->literal = rle->used;
+				chrome_rle_put(rle, 0);
+			} else
+				rle->out[rle->literal]++;
+			chrome_rle_put(rle, rle->value);
+		}
+	}
+
+	rle->run = 0;
+}
+
+static void
+chrome_rle_encode(struct chrome_rle_encoder *rle, unsigned char byte)
+{
+	if (rle->run && (byte == rle->value) &&
+	    (rle->run < CHROME_RLE_REPEAT_MAX)) {
+		rle->run++;
+		return;
+	}
+
+	chrome_rle_flush(rle);
+	rle->value = byte;
+	rle->run = 1;
+}
+
+struct chrome_rle {
+	const unsigned char *in;
+	int literal, repeat;
+	unsigned char value;
+};
+
+static unsigned char
+chrome_rle_next(struct chrome_rle *rle)
+{
+	unsigned char control;
+
+	if (!rle->literal && !rle->repeat) {
+		control = *rle->in++;
+		if (control < 0x80)
+			rle->literal = control + 1;
+		else {
+			rle->repeat = control - 0x80 + CHROME_RLE_REPEAT_MIN;
+			rle->value = *rle->in++;
+		}
+	}
+
+	if (rle->literal) {
+		rle->literal--;
+		return *rle->in++;
+	}
+
+	rle->repeat--;
+	return rle->value;
+}
+
+/*
+ * Grab planes 0 to 2 and keep them encoded.
+ */
+static void
+chrome_textmode_planes_store(struct chrome_info *info)
+{
+	struct chrome_state *state = &info->state;
+	struct chrome_rle_encoder rle[VGA_FB_PLANES_STORED];
+	unsigned char bounce[CHROME_TEXT_BOUNCE];
+	int plane, offset, i, size = 0;
+
+	for (plane = 0; plane < VGA_FB_PLANES_STORED; plane++) {
+		rle[plane].out = vmalloc(CHROME_RLE_INITIAL);
+		rle[plane].size = CHROME_RLE_INITIAL;
+		rle[plane].used = 0;
+		rle[plane].literal = -1;
+		rle[plane].run = 0;
+	}
+
+	for (offset = 0; offset < (4 * VGA_FB_PLANE_SIZE);
+	     offset += CHROME_TEXT_BOUNCE) {
+		memcpy_fromio(bounce, info->fbbase + offset, CHROME_TEXT_BOUNCE);
+		for (i = 0; i < CHROME_TEXT_BOUNCE; i += 4)
+			for (plane = 0; plane < VGA_FB_PLANES_STORED; plane++)
+				chrome_rle_encode(&rle[plane], bounce[i + plane]);
+	}
+
+	for (plane = 0; plane < VGA_FB_PLANES_STORED; plane++) {
+		chrome_rle_flush(&rle[plane]);
+		if (!rle[plane].out)
+			size = -1;
+		else if (size >= 0)
+			size += rle[plane].used;
+	}
+
+	state->planes = (size > 0) ? vmalloc(size) : NULL;
+	if (state->planes) {
+		size = 0;
+		for (plane = 0; plane < VGA_FB_PLANES_STORED; plane++) {
+			state->planes_offset[plane] = size;
+			memcpy(state->planes + size, rle[plane].out,
+			       rle[plane].used);
+			size += rle[plane].used;
+		}
+		state->planes_size = size;
+	} else
+		printk(KERN_ERR "Unable to store VGA FB planes.\n");
+
+	for (plane = 0; plane < VGA_FB_PLANES_STORED; plane++)
+		vfree(rle[plane].out);
+}
+
+/*
+ * Plane 3 comes back empty.
+ */
+static void
+chrome_textmode_planes_restore(struct chrome_info *info)
+{
+	struct chrome_state *state = &info->state;
+	struct chrome_rle rle[VGA_FB_PLANES_STORED];
+	unsigned char bounce[CHROME_TEXT_BOUNCE];
+	int plane, offset, i;
+
+	for (plane = 0; plane < VGA_FB_PLANES_STORED; plane++) {
+		rle[plane].in = state->planes + state->planes_offset[plane];
+		rle[plane].literal = 0;
+		rle[plane].repeat = 0;
+	}
+
+	for (offset = 0; offset < (4 * VGA_FB_PLANE_SIZE);
+	     offset += CHROME_TEXT_BOUNCE) {
+		for (i = 0; i < CHROME_TEXT_BOUNCE; i += 4) {
+			for (plane = 0; plane < VGA_FB_PLANES_STORED; plane++)
+				bounce[i + plane] = chrome_rle_next(&rle[plane]);
+			bounce[i + 3] = 0;
+		}
+		memcpy_toio(info->fbbase + offset, bounce, CHROME_TEXT_BOUNCE);
+	}
+}
+
 /*
  * Store the full VGA/textmode state for later restoration.
  */
@@ -63,30 +279,26 @@ chrome_textmode_store(struct chrome_info *info)
 		state->GR[i] = chrome_vga_graph_read(info, i);
 
 	/* Attribute registers */
+	spin_lock(&info->vga_lock);
 	for (i = 0x00; i < 0x14; i++)
 		state->AR[i] = chrome_vga_attr_read(info, i);
+	spin_unlock(&info->vga_lock);
 
 	state->Misc = chrome_vga_misc_read(info);
 
 	/* store VGA memory? */
-	if (!(state->AR[0x10] & 0x01)) { /* don't bother when in graphics mode */
-		/* four planes, two are font data, two are text */
-		state->planes = (unsigned char *) vmalloc(4 * VGA_FB_PLANE_SIZE);
-
-		if (state->planes)
-			/* Cheat: just grab the lowest 256kB from already mapped FB */
-			memcpy(state->planes, info->fbbase, 4 * VGA_FB_PLANE_SIZE);
-		else
-			printk(KERN_ERR "Unable to store VGA FB planes.\n");
-	}
+	if (!(state->AR[0x10] & 0x01)) /* don't bother when in graphics mode */
+		chrome_textmode_planes_store(info);
 
 	/* store palette */
+	spin_lock(&info->vga_lock);
 	chrome_vga_dac_read_address(info, 0x00);
 	for (i = 0; i < 0x100; i++) {
 		state->palette[i].red = chrome_vga_dac_read(info);
 		state->palette[i].green = chrome_vga_dac_read(info);
 		state->palette[i].blue = chrome_vga_dac_read(info);
 	}
+	spin_unlock(&info->vga_lock);
 
         state->stored = 1;
 }
@@ -98,6 +310,7 @@ static void
 chrome_textmode_restore(struct chrome_info *info)
 {
 	struct chrome_state *state = &info->state;
+	u64 start = chrome_time_ns();
 	int i;
 
 	DBG(__func__);
@@ -126,20 +339,24 @@ chrome_textmode_restore(struct chrome_info *info)
 		chrome_vga_graph_write(info, i, state->GR[i]);
 
 	/* Attribute registers */
+	spin_lock(&info->vga_lock);
 	for (i = 0x00; i < 0x14; i++)
 		chrome_vga_attr_write(info, i, state->AR[i]);
+	spin_unlock(&info->vga_lock);
 
 	/* Restore FB */
 	if (state->planes)
-		memcpy(info->fbbase, state->planes, 4 * VGA_FB_PLANE_SIZE);
+		chrome_textmode_planes_restore(info);
 
 	/* Restore palette */
+	spin_lock(&info->vga_lock);
 	chrome_vga_dac_write_address(info, 0x00);
 	for (i = 0; i < 0x100; i++) {
 		chrome_vga_dac_write(info, state->palette[i].red);
 		chrome_vga_dac_write(info, state->palette[i].green);
 		chrome_vga_dac_write(info, state->palette[i].blue);
 	}
+	spin_unlock(&info->vga_lock);
 
 	/* Reset clock */
 	chrome_vga_seq_mask(info, 0x40, 0x06, 0x06);
@@ -149,6 +366,9 @@ chrome_textmode_restore(struct chrome_info *info)
 
 	/* Synchronous reset disable */
 	chrome_vga_seq_mask(info, 0x00, 0x02, 0x02);
+
+	printk(KERN_INFO "%s: textmode restore %uus\n",
+	       pci_name(info->pci_dev), chrome_time_us(chrome_time_ns() - start));
 }
 
 /*
@@ -161,6 +381,14 @@ chrome_open(struct fb_info *fb_info, int user)
 
 	DBG(__func__);
 
+	chrome_init_wait(info);
+
+	/* userspace might reprogram behind our back */
+	if (user) {
+		info->mode_adopted = 0;
+		chrome_vt_open(info);
+	}
+
 	atomic_inc(&info->fb_ref_count);
 
 	return 0;
@@ -179,6 +407,12 @@ chrome_release(struct fb_info *fb_info, int user)
 	if (!atomic_read(&info->fb_ref_count))
 		return -EINVAL;
 
+	/* Don't let a dying client keep the engine. This runs in whoever
+	 * drops the file last, not necessarily who opened it or took the
+	 * engine, so only the last close can tell that no holder is left. */
+	if (user && chrome_vt_release(info))
+		chrome_engine_unlock(info, 0);
+
 	atomic_dec(&info->fb_ref_count);
 
 	return 0;
@@ -194,10 +428,8 @@ chrome_check_var(struct fb_var_screeninfo *mode, struct fb_info *fb_info)
 	__u32 temp, bytes_per_pixel;
 	int ret;
 
-	DBG(__func__);
-
-        printk("Checking %dx%d@%dbpp at %ldkHz\n", mode->xres, mode->yres,
-               mode->bits_per_pixel, PICOS2KHZ(mode->pixclock));
+	CHROME_DEBUG("Checking %dx%d@%dbpp at %ldkHz\n", mode->xres, mode->yres,
+		     mode->bits_per_pixel, PICOS2KHZ(mode->pixclock));
 
 	/* bpp */
 	switch (mode->bits_per_pixel) {
@@ -215,6 +447,18 @@ chrome_check_var(struct fb_var_screeninfo *mode, struct fb_info *fb_info)
 		return -EINVAL;
 	}
 
+	/* Rotation, through a shadow: no panning. */
+	if (mode->rotate > FB_ROTATE_CCW) {
+		printk(KERN_WARNING "Unsupported rotation: %d.\n", mode->rotate);
+		return -EINVAL;
+	}
+	if (mode->rotate) {
+		mode->xres_virtual = mode->xres;
+		mode->yres_virtual = mode->yres;
+		mode->xoffset = 0;
+		mode->yoffset = 0;
+	}
+
 	/* Virtual */
 	temp = mode->xres_virtual * mode->yres_virtual * bytes_per_pixel;
 	if (temp >= info->fbsize * 1024) {
@@ -224,8 +468,8 @@ chrome_check_var(struct fb_var_screeninfo *mode, struct fb_info *fb_info)
 		return -EINVAL;
 	}
 
-	/* Mode */
-        ret = chrome_mode_valid(info, mode);
+	/* Mode: a lookup, for anything on the modelist */
+	ret = chrome_mode_image_valid(info, mode);
 	if (ret)
 		return ret;
 
@@ -293,15 +537,37 @@ chrome_check_var(struct fb_var_screeninfo *mode, struct fb_info *fb_info)
 		return -EINVAL;
 	}
 
-	/* Rotation - not yet. */
-	if (mode->rotate) {
-		printk(KERN_WARNING "We don't do rotation yet.\n");
-		return -EINVAL;
-	}
-
 	return 0;
 }
 
+/*
+ * Pack a cmap entry for the current truecolor layout.
+ */
+static inline u32
+chrome_pseudo_colour(struct fb_var_screeninfo *mode, __u16 red, __u16 green,
+                     __u16 blue)
+{
+	return ((red >> (16 - mode->red.length)) << mode->red.offset) |
+		((green >> (16 - mode->green.length)) << mode->green.offset) |
+		((blue >> (16 - mode->blue.length)) << mode->blue.offset);
+}
+
+/*
+ * The console only ever looks up the first 16 entries; cfb_imageblit and
+ * cfb_fillrect index this table directly in truecolor modes.
+ */
+static void
+chrome_pseudo_palette_fill(struct chrome_info *info, struct fb_cmap *cmap)
+{
+	struct fb_var_screeninfo *mode = &info->fb_info.var;
+	int i;
+
+	for (i = 0; (i < cmap->len) && ((cmap->start + i) < 16); i++)
+		info->pseudo_palette[cmap->start + i] =
+			chrome_pseudo_colour(mode, cmap->red[i],
+					     cmap->green[i], cmap->blue[i]);
+}
+
 /*
  *
  */
@@ -310,15 +576,52 @@ chrome_set_par(struct fb_info *fb_info)
 {
 	struct chrome_info *info = (struct chrome_info *) fb_info;
 	struct fb_var_screeninfo *mode = &fb_info->var;
+	__u32 bytes_per_pixel;
 	int ret;
 
-	DBG(__func__);
+	chrome_init_wait(info);
 
-	ret = chrome_mode_write(info, mode);
+	/* as programmed in CR13: 32byte aligned */
+	if (mode->bits_per_pixel < 24)
+		bytes_per_pixel = mode->bits_per_pixel >> 3;
+	else
+		bytes_per_pixel = 4;
+	fb_info->fix.line_length =
+		((mode->xres_virtual * bytes_per_pixel) + 31) & ~31;
+
+	/* before touching the CRTC, this can run out of memory */
+	ret = chrome_rotate_set(info);
 	if (ret)
 		return ret;
 
-        fb_info->fix.line_length = mode->xres * (mode->bits_per_pixel >> 3);
+	chrome_soft_select(info);
+
+	chrome_lut_invalidate(info);
+
+	/* Only once: after this, we can no longer trust the hardware. */
+	if (info->mode_adopted && chrome_mode_equal(mode, &info->mode_firmware)) {
+		CHROME_DEBUG("%s: keeping firmware mode.\n", __func__);
+		chrome_engine_invalidate(info);
+		chrome_scanline_mode(info, mode);
+	} else if (chrome_vt_restore(info, mode)) {
+		/* not back from a client: everything */
+		chrome_engine_invalidate(info);
+		ret = chrome_mode_write(info, mode);
+		if (ret)
+			return ret;
+	}
+	info->mode_adopted = 0;
+	info->vt_mode = *mode;
+
+	fb_info->fix.type = FB_TYPE_PACKED_PIXELS;
+	if (mode->bits_per_pixel == 8)
+		fb_info->fix.visual = FB_VISUAL_PSEUDOCOLOR;
+	else {
+		fb_info->fix.visual = FB_VISUAL_TRUECOLOR;
+
+		/* bpp changed underneath the console: repack its colours */
+		chrome_pseudo_palette_fill(info, &fb_info->cmap);
+	}
 
 	return 0;
 }
@@ -330,58 +633,73 @@ static int
 chrome_setcmap(struct fb_cmap *cmap, struct fb_info *fb_info)
 {
 	struct chrome_info *info = (struct chrome_info *) fb_info;
-	int i;
 
-	DBG(__func__);
+	chrome_init_wait(info);
 
-	if (cmap->start + cmap->len > 0xFF)
+	if ((cmap->start + cmap->len) > 0x100)
 		return -EINVAL;
 
-	chrome_vga_dac_mask_write(info, 0xFF);
-
-	chrome_vga_dac_write_address(info, cmap->start);
-	for (i = cmap->start; i < (cmap->start + cmap->len); i++) {
-		chrome_vga_dac_write(info, cmap->red[i] & 0xFF);
-		chrome_vga_dac_write(info, cmap->green[i] & 0xFF);
-		chrome_vga_dac_write(info, cmap->blue[i] & 0xFF);
+	/* Truecolor: the DAC is bypassed, only the console needs colours. */
+	if (fb_info->fix.visual == FB_VISUAL_TRUECOLOR) {
+		chrome_pseudo_palette_fill(info, cmap);
+		return 0;
 	}
 
-	/* So, erm... What about the overscan colour then?
-	 * Are you telling me FB has no notion of that either?
-	 */
-	/* just pick 0x00, which is hopefully black*/
-	chrome_vga_attr_write(info, 0x11, 0x00);
+	/* Uploaded at the next retrace, see chrome_lut.c */
+	chrome_lut_set(info, cmap);
 
 	/* We still need to set the Gamma enable bits somewhere */
 	return 0;
 }
 
 /*
- * Very rudimentary, could be mightily advanced though.
+ * Screen off (SR01 bit 5) stops display fetch altogether, which hands the
+ * scanout bandwidth back to the cpu on these shared memory parts. The
+ * deeper levels also drop syncs through the DPMS bits in CR36, which
+ * powers down the CRT DAC as well. The CRTC itself keeps its timing, so
+ * unblanking needs no modeset.
  */
 static int
 chrome_blank(int blank, struct fb_info *fb_info)
 {
 	struct chrome_info *info = (struct chrome_info *) fb_info;
+	unsigned char dpms;
 
-	DBG(__func__);
+	chrome_init_wait(info);
 
 	switch (blank) {
 	case FB_BLANK_UNBLANK:
-		chrome_vga_cr_mask(info, 0x17, 0x80, 0x80);
-		/* outputs? */
-		break;
 	case FB_BLANK_NORMAL:
-	case FB_BLANK_VSYNC_SUSPEND:
-	case FB_BLANK_HSYNC_SUSPEND:
+		dpms = 0x00;
+		break;
+	case FB_BLANK_HSYNC_SUSPEND: /* standby */
+		dpms = 0x10;
+		break;
+	case FB_BLANK_VSYNC_SUSPEND: /* suspend */
+		dpms = 0x20;
+		break;
 	case FB_BLANK_POWERDOWN:
-		chrome_vga_cr_mask(info, 0x17, 0x00, 0x80);
-		/* outputs? */
-		/* We could do so much more here */
+		dpms = 0x30;
 		break;
 	default:
 		return -EINVAL;
 	}
+
+	if (blank == info->blank)
+		return 0;
+
+	if (blank == FB_BLANK_UNBLANK) {
+		chrome_vga_cr_mask(info, 0x36, dpms, 0x30);
+		chrome_vga_cr_mask(info, 0x17, 0x80, 0x80);
+		chrome_vga_seq_mask(info, 0x01, 0x00, 0x20);
+	} else {
+		chrome_vga_seq_mask(info, 0x01, 0x20, 0x20);
+		chrome_vga_cr_mask(info, 0x36, dpms, 0x30);
+	}
+	/* outputs other than the CRT are not handled yet */
+
+	info->blank = blank;
+
 	return 0;
 }
 
@@ -394,14 +712,17 @@ chrome_pan_display(struct fb_var_screeninfo *mode, struct fb_info *fb_info)
 	struct chrome_info *info = (struct chrome_info *) fb_info;
 	__u32 base;
 
-	DBG(__func__);
+	chrome_init_wait(info);
 
-	base = (mode->xoffset * mode->xres_virtual) + mode->yoffset;
-	if (mode->bits_per_pixel < 24)
-		base *= mode->bits_per_pixel / 8;
-	else
-		base *= 4;
-	base >>= 1;
+	/* rotated: the scanout is not what the console sees */
+	if (info->shadow && info->rotate)
+		return (mode->xoffset || mode->yoffset) ? -EINVAL : 0;
+
+	/* unrotated shadow: the lines panned to have to be there */
+	if (info->shadow)
+		chrome_rotate_flush(info);
+
+	base = chrome_mode_start(mode, fb_info->fix.line_length);
 
 	chrome_vga_cr_write(info, 0x0C, (base >> 8) & 0xFF);
 	chrome_vga_cr_write(info, 0x0D, base & 0xFF);
@@ -420,10 +741,248 @@ chrome_pan_display(struct fb_var_screeninfo *mode, struct fb_info *fb_info)
 static int
 chrome_sync(struct fb_info *fb_info)
 {
-	/* not using 2D engine yet. */
+	struct chrome_info *info = (struct chrome_info *) fb_info;
+
+	chrome_init_wait(info);
+
+	return chrome_engine_sync(info, 0);
+}
+
+/*
+ * CHROMEFB_IOC_RECT.
+ */
+static int
+chrome_ioctl_rect(struct chrome_info *info, void __user *arg)
+{
+	struct fb_info *fb_info = &info->fb_info;
+	struct fb_var_screeninfo *mode = &fb_info->var;
+	struct chromefb_rect rect;
+	int top, bottom, lines;
+
+	if (copy_from_user(&rect, arg, sizeof(rect)))
+		return -EFAULT;
+
+	if (rect.flags & ~(CHROMEFB_RECT_COPY | CHROMEFB_RECT_BEAM))
+		return -EINVAL;
+
+	if (!rect.width || !rect.height ||
+	    (rect.width > mode->xres_virtual) ||
+	    (rect.height > mode->yres_virtual) ||
+	    (rect.dx > (mode->xres_virtual - rect.width)) ||
+	    (rect.dy > (mode->yres_virtual - rect.height)))
+		return -EINVAL;
+
+	if ((rect.flags & CHROMEFB_RECT_COPY) &&
+	    ((rect.sx > (mode->xres_virtual - rect.width)) ||
+	     (rect.sy > (mode->yres_virtual - rect.height))))
+		return -EINVAL;
+
+	/* a console colour: indexes the pseudo palette in truecolor */
+	if (!(rect.flags & CHROMEFB_RECT_COPY) &&
+	    (rect.colour >= ((fb_info->fix.visual == FB_VISUAL_TRUECOLOR) ?
+			     16 : 256)))
+		return -EINVAL;
+
+	/* A shadow gets rotated out later, the beam is of no concern. */
+	if ((rect.flags & CHROMEFB_RECT_BEAM) && !info->shadow) {
+		top = (int) rect.dy - (int) mode->yoffset;
+		bottom = top + rect.height;
+
+		/* the beam counts output lines, which the scaler stretches */
+		if (info->scale) {
+			lines = info->mode_output.yres;
+			top = (top * lines) / (int) mode->yres;
+			bottom = (bottom * lines + (int) mode->yres - 1) /
+				(int) mode->yres;
+		}
+
+		chrome_scanline_wait(info, top, bottom);
+	}
+
+	if (rect.flags & CHROMEFB_RECT_COPY) {
+		struct fb_copyarea area;
+
+		area.dx = rect.dx;
+		area.dy = rect.dy;
+		area.sx = rect.sx;
+		area.sy = rect.sy;
+		area.width = rect.width;
+		area.height = rect.height;
+
+		chrome_copyarea(fb_info, &area);
+	} else {
+		struct fb_fillrect fill;
+
+		fill.dx = rect.dx;
+		fill.dy = rect.dy;
+		fill.width = rect.width;
+		fill.height = rect.height;
+		fill.color = rect.colour;
+		fill.rop = ROP_COPY;
+
+		chrome_fillrect(fb_info, &fill);
+	}
+
+	/* Get it out while the beam is still elsewhere: a sleep would lose
+	 * the window. */
+	if (rect.flags & CHROMEFB_RECT_BEAM)
+		chrome_engine_sync(info, 0);
+
+	return 0;
+}
+
+/*
+ *
+ */
+static int
+chrome_ioctl(struct fb_info *fb_info, unsigned int cmd, unsigned long arg)
+{
+	struct chrome_info *info = (struct chrome_info *) fb_info;
+
+	chrome_init_wait(info);
+
+	switch (cmd) {
+	case CHROMEFB_IOC_ENGINE_LOCK:
+		if (!info->accel)
+			return -ENODEV;
+		return chrome_engine_lock(info, current->tgid);
+	case CHROMEFB_IOC_ENGINE_UNLOCK:
+		chrome_engine_unlock(info, current->tgid);
+		return 0;
+	case CHROMEFB_IOC_RECT:
+		return chrome_ioctl_rect(info, (void __user *) arg);
+	case CHROMEFB_IOC_CAPTURE: {
+		struct chromefb_capture capture;
+
+		if (copy_from_user(&capture, (void __user *) arg,
+				   sizeof(capture)))
+			return -EFAULT;
+		return chrome_capture(info, &capture);
+	}
+	case CHROMEFB_IOC_SPLIT: {
+		__u32 lines;
+
+		if (get_user(lines, (__u32 __user *) arg))
+			return -EFAULT;
+		return chrome_mode_split(info, lines);
+	}
+	default:
+		return -ENOTTY;
+	}
+}
+
+/*
+ * The default fb_mmap, but for the rotation shadow.
+ */
+static int
+chrome_mmap(struct fb_info *fb_info, struct vm_area_struct *vma)
+{
+	struct chrome_info *info = (struct chrome_info *) fb_info;
+	unsigned long offset = vma->vm_pgoff << PAGE_SHIFT;
+	unsigned long size = vma->vm_end - vma->vm_start;
+	unsigned long start = fb_info->fix.smem_start;
+	unsigned long length = PAGE_ALIGN(fb_info->fix.smem_len);
+
+	chrome_init_wait(info);
+
+	if (offset < length) {
+		if (info->shadow)
+			return chrome_rotate_mmap(info, vma);
+	} else {
+		/* MMIO follows, as with the default fb_mmap */
+		offset -= length;
+		start = fb_info->fix.mmio_start;
+		length = PAGE_ALIGN(fb_info->fix.mmio_len);
+	}
+
+	if ((offset + size) > length)
+		return -EINVAL;
+
+	vma->vm_flags |= VM_IO | VM_RESERVED;
+	vma->vm_page_prot = pgprot_noncached(vma->vm_page_prot);
+
+	if (io_remap_pfn_range(vma, vma->vm_start, (start + offset) >> PAGE_SHIFT,
+			       size, vma->vm_page_prot))
+		return -EAGAIN;
 	return 0;
 }
 
+/*
+ *
+ * Op tracing: latency and main arguments of the ops, into the trace ring.
+ *
+ */
+static int
+chrome_op_check_var(struct fb_var_screeninfo *mode, struct fb_info *fb_info)
+{
+	struct chrome_info *info = (struct chrome_info *) fb_info;
+	u64 start = chrome_trace_start(info);
+	int ret = chrome_check_var(mode, fb_info);
+
+	CHROME_TRACE_DONE(info, CHROME_TRACE_OP_CHECK_VAR, start, ret,
+			(mode->xres << 16) | mode->yres, mode->bits_per_pixel);
+	return ret;
+}
+
+static int
+chrome_op_set_par(struct fb_info *fb_info)
+{
+	struct chrome_info *info = (struct chrome_info *) fb_info;
+	struct fb_var_screeninfo *mode = &fb_info->var;
+	u64 start = chrome_trace_start(info);
+	int ret = chrome_set_par(fb_info);
+
+	CHROME_TRACE_DONE(info, CHROME_TRACE_OP_SET_PAR, start, ret,
+			(mode->xres << 16) | mode->yres, mode->bits_per_pixel);
+	return ret;
+}
+
+static int
+chrome_op_setcmap(struct fb_cmap *cmap, struct fb_info *fb_info)
+{
+	struct chrome_info *info = (struct chrome_info *) fb_info;
+	u64 start = chrome_trace_start(info);
+	int ret = chrome_setcmap(cmap, fb_info);
+
+	CHROME_TRACE_DONE(info, CHROME_TRACE_OP_SETCMAP, start, ret,
+			(cmap->start << 16) | cmap->len, 0);
+	return ret;
+}
+
+static int
+chrome_op_blank(int blank, struct fb_info *fb_info)
+{
+	struct chrome_info *info = (struct chrome_info *) fb_info;
+	u64 start = chrome_trace_start(info);
+	int ret = chrome_blank(blank, fb_info);
+
+	CHROME_TRACE_DONE(info, CHROME_TRACE_OP_BLANK, start, ret, blank, 0);
+	return ret;
+}
+
+static int
+chrome_op_pan_display(struct fb_var_screeninfo *mode, struct fb_info *fb_info)
+{
+	struct chrome_info *info = (struct chrome_info *) fb_info;
+	u64 start = chrome_trace_start(info);
+	int ret = chrome_pan_display(mode, fb_info);
+
+	CHROME_TRACE_DONE(info, CHROME_TRACE_OP_PAN, start, ret,
+			(mode->xoffset << 16) | mode->yoffset, 0);
+	return ret;
+}
+
+static int
+chrome_op_sync(struct fb_info *fb_info)
+{
+	struct chrome_info *info = (struct chrome_info *) fb_info;
+	u64 start = chrome_trace_start(info);
+	int ret = chrome_sync(fb_info);
+
+	CHROME_TRACE_DONE(info, CHROME_TRACE_OP_SYNC, start, ret, 0, 0);
+	return ret;
+}
+
 /*
  * FB driver callbacks.
  */
@@ -432,17 +991,21 @@ static struct fb_ops chrome_ops __devinitdata = {
 	.owner =  THIS_MODULE,
 	.fb_open =  chrome_open,
 	.fb_release =  chrome_release,
-	.fb_check_var =  chrome_check_var,
-	.fb_set_par =  chrome_set_par,
+	.fb_read =  chrome_fb_read,
+	.fb_write =  chrome_fb_write,
+	.fb_check_var =  chrome_op_check_var,
+	.fb_set_par =  chrome_op_set_par,
 	.fb_setcolreg =  NULL, /* use set_cmap instead */
-	.fb_setcmap = chrome_setcmap,
-	.fb_blank =  chrome_blank,
-	.fb_pan_display =  chrome_pan_display,
-	.fb_fillrect =  cfb_fillrect,
-	.fb_copyarea =  cfb_copyarea,
-	.fb_imageblit =  cfb_imageblit,
+	.fb_setcmap = chrome_op_setcmap,
+	.fb_blank =  chrome_op_blank,
+	.fb_pan_display =  chrome_op_pan_display,
+	.fb_fillrect =  chrome_fillrect,
+	.fb_copyarea =  chrome_copyarea,
+	.fb_imageblit =  chrome_imageblit,
 	/* .fb_cursor =  soft_cursor, */
-	.fb_sync =  chrome_sync,
+	.fb_sync =  chrome_op_sync,
+	.fb_mmap =  chrome_mmap,
+	.fb_ioctl =  chrome_ioctl,
 };
 
 
@@ -460,6 +1023,22 @@ MODULE_DESCRIPTION("FBDev driver for VIA Unichrome and Chrome IGPs");
 
 #endif /* MODULE */
 
+module_param(noaccel, bool, 0);
+MODULE_PARM_DESC(noaccel, "Disable 2D engine acceleration");
+module_param(nodirect, bool, 0);
+MODULE_PARM_DESC(nodirect,
+		 "Reach the framebuffer through the PCI BAR, not the host bridge");
+module_param(async_probe, bool, 0);
+MODULE_PARM_DESC(async_probe,
+		 "Capture textmode and set the initial mode after probe (default 1)");
+module_param_named(mode, mode_option, charp, 0);
+MODULE_PARM_DESC(mode, "Initial mode, as in \"1024x768-16@60\"");
+module_param_named(output, output_option, charp, 0);
+MODULE_PARM_DESC(output,
+		 "Fixed output timing, smaller modes get scaled up to it");
+module_param_named(debug, chrome_debug, bool, S_IRUGO | S_IWUSR);
+MODULE_PARM_DESC(debug, "Debug messages, can be switched at runtime");
+
 static struct pci_device_id chrome_devices[] = {
 	{PCI_VENDOR_ID_VIA, PCI_CHIP_VT3122, PCI_ANY_ID, PCI_ANY_ID, 0, 0, 1},
 	{PCI_VENDOR_ID_VIA, PCI_CHIP_VT7205, PCI_ANY_ID, PCI_ANY_ID, 0, 0, 1},
@@ -583,36 +1162,123 @@ chrome_io_release(struct chrome_info *info)
 }
 
 /*
- * Do everything to grab FB memory and then making sure that it is fully
- * accessible.
+ *
+ */
+static void
+chrome_fb_unmap(struct chrome_info *info)
+{
+	unsigned int size = info->fbsize * 1024;
+
+	if (info->fbbase)
+		iounmap(info->fbbase);
+	info->fbbase = NULL;
+
+#ifdef CONFIG_MTRR
+	if (info->fb_mtrr >= 0)
+		mtrr_del(info->fb_mtrr, info->fb_physical, size);
+#endif
+	info->fb_mtrr = -1;
+
+	release_mem_region(info->fb_physical, size);
+}
+
+/*
+ * Write combining when an MTRR can be had; the mapping then has to leave
+ * the caching to the MTRR. Uncached otherwise.
  */
 static int
-chrome_fb_init(struct chrome_info *info)
+chrome_fb_map(struct chrome_info *info, unsigned int base)
 {
-	struct fb_fix_screeninfo *fix = &(info->fb_info.fix);
 	unsigned int size = info->fbsize * 1024;
 
-	DBG(__func__);
+	if (!request_mem_region(base, size, DRIVER_NAME))
+		return -EBUSY;
 
-	if (!request_mem_region(info->fb_physical, size, DRIVER_NAME)) {
-		printk(KERN_ERR "%s: Cannot request FB resource.\n", __func__);
-		return -ENODEV;
-	}
+	info->fb_physical = base;
+	info->fb_mtrr = -1;
+#ifdef CONFIG_MTRR
+	info->fb_mtrr = mtrr_add(base, size, MTRR_TYPE_WRCOMB, 1);
+#endif
 
-	info->fbbase = ioremap_nocache(info->fb_physical, size);
+	if (info->fb_mtrr >= 0)
+		info->fbbase = ioremap(base, size);
+	else
+		info->fbbase = ioremap_nocache(base, size);
 	if (!info->fbbase) {
-		printk(KERN_ERR "%s: Unable to remap FB region.\n", __func__);
-		release_mem_region(info->fb_physical, size);
-		return -ENODEV;
+		chrome_fb_unmap(info);
+		return -ENOMEM;
 	}
 
-        printk(KERN_DEBUG "%s: Mapping 0x%08X (0x%08X) at 0x%08X\n",
-               __func__, info->fb_physical, size, (int) info->fbbase);
+	return 0;
+}
 
-	/* Set up the fix structure -- why is this so mangled? */
-	fix->smem_start = info->fb_physical;
-	fix->smem_len = size;
-        info->fb_info.screen_base = info->fbbase;
+/*
+ * Does a window at base reach the same memory as BAR 0? A pattern written
+ * to the last page through BAR 0 has to show up there. Only BAR 0, which
+ * is known to be the FB, gets written to: the candidate might end up
+ * anywhere in RAM, so it is only read from, and only through an uncached
+ * mapping of a single page. The original contents go back.
+ */
+static int
+chrome_fb_validate(struct chrome_info *info, unsigned int base)
+{
+	static const u32 patterns[] = {
+		0x5AA55AA5, 0xA55AA55A, 0x01234567, 0xFEDCBA98,
+	};
+	unsigned long offset = info->fbsize * 1024 - PAGE_SIZE;
+	void __iomem *pci, *window;
+	u32 save[ARRAY_SIZE(patterns)];
+	int i, ret = 0;
+
+	pci = ioremap_nocache(info->fb_pci + offset, PAGE_SIZE);
+	if (!pci)
+		return -ENOMEM;
+
+	window = ioremap_nocache(base + offset, PAGE_SIZE);
+	if (!window) {
+		iounmap(pci);
+		return -ENOMEM;
+	}
+
+	for (i = 0; i < ARRAY_SIZE(patterns); i++) {
+		save[i] = readl(pci + 4 * i);
+		writel(patterns[i], pci + 4 * i);
+	}
+	/* flush posted writes */
+	readl(pci);
+
+	for (i = 0; i < ARRAY_SIZE(patterns); i++)
+		if (readl(window + 4 * i) != patterns[i])
+			ret = -EIO;
+
+	for (i = 0; i < ARRAY_SIZE(patterns); i++)
+		writel(save[i], pci + 4 * i);
+	readl(pci);
+
+	iounmap(window);
+	iounmap(pci);
+	return ret;
+}
+
+/*
+ * Do everything to grab FB memory and then making sure that it is fully
+ * accessible.
+ *
+ * The direct CPU window of the host bridge goes to the framebuffer in
+ * system RAM without a trip through the chip, so it is preferred, when it
+ * turns out to reach what BAR 0 reaches. That can only be told once
+ * extended memory access is enabled, so that happens first.
+ */
+static int
+chrome_fb_init(struct chrome_info *info)
+{
+	struct fb_fix_screeninfo *fix = &(info->fb_info.fix);
+	unsigned int size = info->fbsize * 1024;
+
+	DBG(__func__);
+
+	info->fbbase = NULL;
+	info->fb_mtrr = -1;
 
 	/* enable writing to all VGA planes */
         info->state.fb_sr02 = chrome_vga_seq_read(info, 0x02);
@@ -626,6 +1292,44 @@ chrome_fb_init(struct chrome_info *info)
         info->state.fb_sr1a = chrome_vga_seq_read(info, 0x1A);
 	chrome_vga_seq_mask(info, 0x1A, 0x08, 0x08);
 
+	if (info->fb_direct && !nodirect) {
+		if (chrome_fb_validate(info, info->fb_direct))
+			printk(KERN_WARNING "%s: Direct FB access at 0x%08X "
+			       "does not reach the FB.\n", __func__,
+			       info->fb_direct);
+		else if (chrome_fb_map(info, info->fb_direct))
+			printk(KERN_WARNING "%s: Cannot map direct FB access at"
+			       " 0x%08X.\n", __func__, info->fb_direct);
+		else
+			info->fb_aperture = CHROME_APERTURE_DIRECT;
+	}
+
+	if (!info->fbbase) {
+		if (chrome_fb_map(info, info->fb_pci)) {
+			printk(KERN_ERR "%s: Cannot request FB resource.\n",
+			       __func__);
+			chrome_vga_seq_mask(info, 0x1A, info->state.fb_sr1a,
+					   0x08);
+			chrome_vga_seq_write(info, 0x04, info->state.fb_sr04);
+			chrome_vga_seq_write(info, 0x02, info->state.fb_sr02);
+			return -ENODEV;
+		}
+		info->fb_aperture = CHROME_APERTURE_PCI;
+	}
+
+	printk(KERN_INFO "%s: FB through %s at 0x%08X, %s.\n", __func__,
+	       (info->fb_aperture == CHROME_APERTURE_DIRECT) ?
+	       "direct CPU access" : "PCI", info->fb_physical,
+	       (info->fb_mtrr >= 0) ? "write combining" : "uncached");
+
+        printk(KERN_DEBUG "%s: Mapping 0x%08X (0x%08X) at 0x%08X\n",
+               __func__, info->fb_physical, size, (int) info->fbbase);
+
+	/* Set up the fix structure -- why is this so mangled? */
+	fix->smem_start = info->fb_physical;
+	fix->smem_len = size;
+        info->fb_info.screen_base = info->fbbase;
+
 	return 0;
 }
 
@@ -644,15 +1348,69 @@ chrome_fb_release(struct chrome_info *info)
         chrome_vga_seq_write(info, 0x04, info->state.fb_sr04);
 	chrome_vga_seq_write(info, 0x02, info->state.fb_sr02);
 
-	iounmap(info->fbbase);
-	release_mem_region(info->fb_physical, info->fbsize *1024);
+	chrome_fb_unmap(info);
 
 	/* induce segfault upon next access */
-	info->fbbase = NULL;
 	fix->smem_start = 0;
 	fix->smem_len = 0;
 }
 
+/*
+ * The slow part of bringing up a device: capturing textmode and the
+ * initial modeset. Runs from a workqueue of its own: everything that
+ * touches the display waits for it through chrome_init_wait(), and fbcon
+ * gets there from console_callback() on keventd, which would then wait on
+ * itself.
+ */
+static void
+chrome_init_worker(struct work_struct *work)
+{
+	struct chrome_info *info =
+		container_of(work, struct chrome_info, init_work);
+	u64 start, stored, calibrated, moded, built;
+
+	DBG(__func__);
+
+	start = chrome_time_ns();
+
+        /* Store state */
+        chrome_textmode_store(info);
+
+	stored = chrome_time_ns();
+
+	/* VRAM is ours now */
+	chrome_calibrate(info);
+
+	calibrated = chrome_time_ns();
+
+	/* The first set_par for this mode will then be a no-op. */
+	if (!info->mode_adopted) {
+		if (!chrome_mode_write(info, &info->mode_firmware))
+			info->mode_adopted = 1;
+	}
+
+	moded = chrome_time_ns();
+
+	/*
+	 * Before init_done: set_par adds images too, and waits for us.
+	 */
+	chrome_modelist_build(info, mode_option);
+
+	built = chrome_time_ns();
+
+	smp_wmb();
+	info->init_ready = 1;
+	complete_all(&info->init_done);
+
+	printk(KERN_INFO "%s: textmode capture %uus (%u bytes kept), "
+	       "calibration %uus, modeset %uus, %d register images %uus\n",
+	       pci_name(info->pci_dev),
+	       chrome_time_us(stored - start), info->state.planes_size,
+	       chrome_time_us(calibrated - stored),
+	       chrome_time_us(moded - calibrated),
+	       info->mode_image_count, chrome_time_us(built - moded));
+}
+
 /*
  * Main initialisation routine.
  */
@@ -660,10 +1418,13 @@ static int __devinit
 chrome_probe(struct pci_dev *dev, const struct pci_device_id *id)
 {
 	struct chrome_info *info;
+	u64 start, hosted, claimed, registered;
 	int err;
 
 	DBG(__func__);
 
+	start = chrome_time_ns();
+
 	err = pci_enable_device(dev);
 	if (err)
 		goto cleanup_err;
@@ -672,9 +1433,21 @@ chrome_probe(struct pci_dev *dev, const struct pci_device_id *id)
 	if (!info)
 		return -ENOMEM;
 
+	INIT_WORK(&info->init_work, chrome_init_worker);
+	init_completion(&info->init_done);
+
+	/* Everything after this uses info->chip instead of the id. */
+	err = chrome_chip_select(info);
+	if (err)
+		goto cleanup_info;
+
 	/* Do this before anything else. */
-	if (chrome_host(info))
+	if (chrome_host(info)) {
+		err = -ENODEV;
                 goto cleanup_info;
+	}
+
+	hosted = chrome_time_ns();
 
 	/* Enable IO */
 	err = chrome_io_init(info);
@@ -686,8 +1459,7 @@ chrome_probe(struct pci_dev *dev, const struct pci_device_id *id)
 	if (err)
 		goto cleanup_io;
 
-        /* Store state */
-        chrome_textmode_store(info);
+	claimed = chrome_time_ns();
 
 	{ /* fractured api */
 		struct fb_fix_screeninfo *fix = &(info->fb_info.fix);
@@ -699,31 +1471,114 @@ chrome_probe(struct pci_dev *dev, const struct pci_device_id *id)
 		fix->accel = 0; /* NONE */
 	}
 
+	chrome_debugfs_init(info);
+	chrome_trace_init(info);
+
+	chrome_mode_init(info);
+	chrome_vt_init(info);
+
+	info->accel = !noaccel && (info->chip->caps & CHROME_CAP_ACCEL);
+	chrome_accel_init(info);
+
+	chrome_soft_init(info);
+	chrome_rotate_init(info);
+	chrome_lut_init(info);
+
+	info->fb_info.flags = FBINFO_DEFAULT;
+	if (info->accel)
+		info->fb_info.flags |= FBINFO_HWACCEL_FILLRECT |
+			FBINFO_HWACCEL_COPYAREA;
+
 	/* Attach FB callbacks */
 	info->fb_info.fbops = &chrome_ops;
+	info->fb_info.pseudo_palette = info->pseudo_palette;
+
+	if (fb_alloc_cmap(&info->fb_info.cmap, 256, 0)) {
+		printk(KERN_ERR "%s: Unable to allocate colourmap.\n", __func__);
+		err = -ENOMEM;
+		goto cleanup_debugfs;
+	}
 
         info->fb_info.device = &dev->dev;
 
-        /* Set up a basic mode. */
-        if (!fb_find_mode(&info->fb_info.var, &info->fb_info, "640x400",
-                          NULL, 0, NULL, 32)) {
+	chrome_scaler_init(info, output_option);
+
+	chrome_modelist_init(info, mode_option);
+
+        /* Take over a usable firmware mode: no blanking, no PLL relock.
+         * Unless the user asked for something else. */
+        if (mode_option &&
+            fb_find_mode(&info->fb_info.var, &info->fb_info, mode_option,
+                         NULL, 0, NULL, 8) &&
+            !chrome_check_var(&info->fb_info.var, &info->fb_info)) {
+                printk(KERN_INFO "Using mode %dx%d@%dbpp.\n",
+                       info->fb_info.var.xres, info->fb_info.var.yres,
+                       info->fb_info.var.bits_per_pixel);
+        } else if (!info->scale &&
+                   !chrome_mode_read(info, &info->fb_info.var) &&
+            !chrome_check_var(&info->fb_info.var, &info->fb_info)) {
+                printk(KERN_INFO "Adopting firmware mode %dx%d@%dbpp.\n",
+                       info->fb_info.var.xres, info->fb_info.var.yres,
+                       info->fb_info.var.bits_per_pixel);
+                info->mode_adopted = 1;
+        } else if (!fb_find_mode(&info->fb_info.var, &info->fb_info,
+                                 "640x400", NULL, 0, NULL, 32)) {
                 printk(KERN_ERR "Failed to get a valid mode for 640x480.\n");
                 err = -EINVAL;
-                goto cleanup_fb;
+                goto cleanup_modelist;
         }
+	info->mode_firmware = info->fb_info.var;
+
+	/* Get the slow bits going, fbcon will wait for them if needed */
+	info->init_wq = NULL;
+	if (async_probe)
+		info->init_wq = create_singlethread_workqueue("chromefb_init");
+	if (info->init_wq)
+		queue_work(info->init_wq, &info->init_work);
+	else
+		chrome_init_worker(&info->init_work);
 
 	err = register_framebuffer(&info->fb_info);
 	if (err) {
 		printk(KERN_ERR "%s: register_framebuffer failed: %d\n",
 		       __func__, err);
-		goto cleanup_fb;
+		goto cleanup_worker;
 	}
 
+	registered = chrome_time_ns();
+
 	/* Attach */
         pci_set_drvdata(dev, &info->fb_info);
+
+	chrome_sysfs_init(info);
+
+	printk(KERN_INFO "%s: probe: host %uus, claim %uus, register %uus%s\n",
+	       pci_name(dev), chrome_time_us(hosted - start),
+	       chrome_time_us(claimed - hosted),
+	       chrome_time_us(registered - claimed),
+	       info->init_ready ? "" : " (textmode capture deferred)");
 	return 0;
 
-cleanup_fb:
+cleanup_worker:
+	wait_for_completion(&info->init_done);
+	if (info->init_wq)
+		destroy_workqueue(info->init_wq);
+cleanup_modelist:
+	fb_destroy_modelist(&info->fb_info.modelist);
+	chrome_modelist_exit(info);
+	fb_dealloc_cmap(&info->fb_info.cmap);
+cleanup_debugfs:
+	/* set up right before the cmap, so every failure after that */
+	chrome_rotate_exit(info);
+	chrome_soft_exit(info);
+	chrome_lut_exit(info);
+	if (info->state.stored)
+		chrome_textmode_restore(info);
+	if (info->state.planes)
+		vfree(info->state.planes);
+	chrome_debugfs_exit(info);
+	chrome_trace_exit(info);
+	chrome_vt_exit(info);
 	chrome_fb_release(info);
 cleanup_io:
 	chrome_io_release(info);
@@ -744,8 +1599,27 @@ chrome_remove(struct pci_dev *dev)
 	DBG(__func__);
 
 	if (info) {
+		/* the worker might still be capturing textmode */
+		wait_for_completion(&info->init_done);
+		if (info->init_wq)
+			destroy_workqueue(info->init_wq);
+
+		chrome_sysfs_exit(info);
+		unregister_framebuffer(&info->fb_info);
+		chrome_modelist_exit(info);
+		chrome_rotate_exit(info);
+		chrome_soft_exit(info);
+		chrome_lut_exit(info);
+
+		chrome_engine_sync(info, 1);
+		chrome_debugfs_exit(info);
+		chrome_trace_exit(info);
+		chrome_vt_exit(info);
+
                 if (info->state.stored)
                         chrome_textmode_restore(info);
+		if (info->state.planes)
+			vfree(info->state.planes);
 
 		if (info->fbbase)
 			chrome_fb_release(info);
@@ -753,16 +1627,131 @@ chrome_remove(struct pci_dev *dev)
 		if (info->iobase)
 			chrome_io_release(info);
 
+		fb_dealloc_cmap(&info->fb_info.cmap);
+
 		pci_set_drvdata(dev, NULL);
 		kfree(info);
 	}
 }
 
+#ifdef CONFIG_PM
+/*
+ *
+ * Power management.
+ *
+ */
+/*
+ * Redo what chrome_io_init() and chrome_fb_init() set up, the original
+ * values are kept from probe.
+ */
+static void
+chrome_resume_io(struct chrome_info *info)
+{
+	chrome_vga_enable_mask(info, 0x01, 0x01);
+	chrome_vga_misc_mask(info, 0x01, 0x01);
+	chrome_vga_seq_write(info, 0x10, 0x01);
+	chrome_vga_seq_mask(info, 0x1A, 0x06, 0x06);
+
+	chrome_vga_seq_write(info, 0x02, 0x0F);
+	chrome_vga_seq_write(info, 0x04, 0x0E);
+	chrome_vga_seq_mask(info, 0x1A, 0x08, 0x08);
+}
+
+/*
+ * Everything that resume undoes happens for every event, so that resume
+ * never restores what was not saved. Only the power state depends on it.
+ */
+static int
+chrome_suspend(struct pci_dev *dev, pm_message_t state)
+{
+	struct chrome_info *info = (struct chrome_info *) pci_get_drvdata(dev);
+
+	DBG(__func__);
+
+	chrome_init_wait(info);
+
+	acquire_console_sem();
+
+	fb_set_suspend(&info->fb_info, 1);
+
+	/* nothing deferred gets to touch the device after this */
+	cancel_rearming_delayed_work(&info->rotate_work);
+	chrome_lut_flush(info);
+
+	chrome_engine_suspend(info);
+
+	pci_save_state(dev);
+	pci_disable_device(dev);
+
+	/* nothing gets powered down for these */
+	if ((state.event != PM_EVENT_FREEZE) &&
+	    (state.event != PM_EVENT_PRETHAW))
+		pci_set_power_state(dev, pci_choose_state(dev, state));
+
+	release_console_sem();
+
+	return 0;
+}
+
+/*
+ *
+ */
+static int
+chrome_resume(struct pci_dev *dev)
+{
+	struct chrome_info *info = (struct chrome_info *) pci_get_drvdata(dev);
+	struct fb_info *fb_info = &info->fb_info;
+	int ret;
+
+	DBG(__func__);
+
+	acquire_console_sem();
+
+	pci_set_power_state(dev, PCI_D0);
+	pci_restore_state(dev);
+
+	ret = pci_enable_device(dev);
+	if (ret) {
+		printk(KERN_ERR "%s: unable to re-enable device.\n", __func__);
+		release_console_sem();
+		return ret;
+	}
+
+	chrome_resume_io(info);
+
+	chrome_engine_resume(info);
+
+	/* firmware might have touched all of it */
+	ret = chrome_mode_write(info, &fb_info->var);
+	if (ret)
+		printk(KERN_ERR "%s: unable to restore mode.\n", __func__);
+
+	chrome_lut_invalidate(info);
+	if (fb_info->var.bits_per_pixel == 8)
+		chrome_lut_set(info, &fb_info->cmap);
+
+	/* also gets the refresh of a mapped shadow going again */
+	if (info->shadow)
+		chrome_rotate_damage(info, 0, 0, fb_info->var.xres,
+				     fb_info->var.yres_virtual);
+
+	fb_set_suspend(fb_info, 0);
+
+	release_console_sem();
+
+	return 0;
+}
+#endif /* CONFIG_PM */
+
 static struct pci_driver chrome_driver = {
 	.name =		DRIVER_NAME,
 	.id_table =	chrome_devices,
 	.probe =	chrome_probe,
-	.remove =	__devexit_p(chrome_remove)
+	.remove =	__devexit_p(chrome_remove),
+#ifdef CONFIG_PM
+	.suspend =	chrome_suspend,
+	.resume =	chrome_resume,
+#endif
 };
 
 
@@ -20,7 +20,9 @@
  *   - Get FB size.
  *   - Get RAM type.
  *   - Get physical FB offset.
- *   - Find out whether we have direct CPU Access.
+ *   - Find out whether we have direct CPU Access, and where.
+ *
+ * Which aperture gets used is up to chrome_fb_init().
  */
 
 #include <linux/fb.h>
@@ -34,16 +36,6 @@
 static void
 chrome_identify(struct chrome_info *info)
 {
-        struct {
-                unsigned int id;
-                char *name;
-        } chromes[] = {
-                { PCI_CHIP_VT3122, "VT3122 (CastleRock)"},
-                { PCI_CHIP_VT7205, "VT7205 (UniChrome)"},
-                { PCI_CHIP_VT3108, "VT3108 (UniChrome Pro)"},
-                { 0, NULL}
-        };
-
         struct {
                 unsigned int id;
                 char *name;
@@ -55,16 +47,9 @@ chrome_identify(struct chrome_info *info)
                 { 0, NULL}
         };
 
-        char *chipname, *hostname;
+        char *hostname;
         int i;
 
-        chipname = "Unknown";
-        for (i = 0; chromes[i].name; i++)
-                if (info->id == chromes[i].id) {
-                        chipname = chromes[i].name;
-                        break;
-                }
-
         hostname = "Unknown";
         for (i = 0; hosts[i].name; i++)
                 if (info->host == hosts[i].id) {
@@ -73,7 +58,7 @@ chrome_identify(struct chrome_info *info)
                 }
 
         printk(KERN_INFO "Found %s on %s Host Bridge (rev. 0x%02X)\n",
-               chipname, hostname, info->host_rev);
+               info->chip->name, hostname, info->host_rev);
 }
 
 /*
@@ -383,7 +368,6 @@ chrome_host(struct chrome_info *info)
         struct pci_dev *host, *ram;
         u8 tmp;
         u16 tmp16;
-        int direct;
 
         DBG(__func__);
 
@@ -455,35 +439,37 @@ chrome_host(struct chrome_info *info)
         }
 
         /* Get FB Base, and check if we have direct access. */
-        direct = 0;
-        info->fb_physical = info->pci_dev->resource[0].start;
+        info->fb_pci = info->pci_dev->resource[0].start;
+        info->fb_direct = 0;
         switch (info->host) {
         case HOST_BRIDGE_CLE266:
         case HOST_BRIDGE_KM400:
                 pci_read_config_word(ram, 0xE0, &tmp16);
-                if ((tmp16 & 0x0001) && (tmp16 & 0x0FFE)) {
-                        direct = 1;
-                        info->fb_physical = (tmp16 & 0xFFE) << 20;
-                }
+                if ((tmp16 & 0x0001) && (tmp16 & 0x0FFE))
+                        info->fb_direct = (tmp16 & 0xFFE) << 20;
                 break;
         case HOST_BRIDGE_K8M800:
                 /* CPU <-> FB rocks here, Chrome <-> FB sucks. */
                 pci_read_config_byte(ram, 0x47, &tmp); /* Get real RAM size */
-                info->fb_physical = (tmp << 24) - (info->fbsize << 10);
-                direct = 1;
+                info->fb_direct = (tmp << 24) - (info->fbsize << 10);
                 break;
         default:
                 pci_read_config_word(ram, 0xA0, &tmp16);
-                if ((tmp16 & 0x0001) && (tmp16 & 0x0FFE)) {
-                        direct = 1;
-                        info->fb_physical = (tmp16 & 0xFFE) << 20;
-                }
+                if ((tmp16 & 0x0001) && (tmp16 & 0x0FFE))
+                        info->fb_direct = (tmp16 & 0xFFE) << 20;
                 break;
         }
-
-        printk(KERN_INFO "Found %dkB FB (%s) at 0x%08X%s\n", info->fbsize,
-               chrome_ram_type_string(info->ram_type), info->fb_physical,
-               (direct ? " (Direct CPU Access)" : ""));
+        info->fb_physical = info->fb_pci;
+
+        if (info->fb_direct)
+                printk(KERN_INFO "Found %dkB FB (%s) at 0x%08X (Direct CPU "
+                       "Access at 0x%08X)\n", info->fbsize,
+                       chrome_ram_type_string(info->ram_type), info->fb_pci,
+                       info->fb_direct);
+        else
+                printk(KERN_INFO "Found %dkB FB (%s) at 0x%08X\n",
+                       info->fbsize, chrome_ram_type_string(info->ram_type),
+                       info->fb_pci);
 
         return 0;
 }
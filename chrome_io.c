@@ -17,26 +17,17 @@
 #include <linux/fb.h>
 
 #include "chrome.h"
+#include "chrome_trace.h"
 
 /*
- * Very noisy debugging.
+ * Register write trace, see chrome_trace.c. Costs a test when off.
  */
-/* #define IO_DEBUG_ENABLE 1 */
-#ifdef IO_DEBUG_ENABLE
-#define IO_DEBUG_WRITE(name, write) \
-        printk(KERN_DEBUG "IO %s -> 0x%02X\n", (name), (write))
-#define IO_DEBUG_MASK(name, read, write, mask) \
-        printk(KERN_DEBUG "IO %s 0x%02X -> 0x%02X@0x%02X\n", (name), (read), (write), (mask))
-#define IO_DEBUG_INDEX_WRITE(name, index, write) \
-        printk(KERN_DEBUG "IO %s%02X -> 0x%02X\n", (name), (index), (write))
-#define IO_DEBUG_INDEX_MASK(name, index, read, write, mask) \
-        printk(KERN_DEBUG "IO %s%02X 0x%02X -> 0x%02X@0x%02X\n", (name), (index), (read), (write), (mask))
-#else
-#define IO_DEBUG_WRITE(name, write)
-#define IO_DEBUG_MASK(name, read, write, mask)
-#define IO_DEBUG_INDEX_WRITE(name, index, write)
-#define IO_DEBUG_INDEX_MASK(name, index, read, write, mask)
-#endif
+#define CHROME_TRACE(info, bank, index, old, value, flags) \
+	do { \
+		if (unlikely((info)->trace_enable)) \
+			chrome_trace((info), (bank), (index), (old), \
+				     (value), (flags)); \
+	} while (0)
 
 /*
  * Remapped VGA access.
@@ -77,7 +68,9 @@ chrome_vga_misc_read(struct chrome_info *info)
 void
 chrome_vga_misc_write(struct chrome_info *info, unsigned char value)
 {
-        IO_DEBUG_WRITE("Misc", value);
+	CHROME_TRACE(info, CHROME_TRACE_MISC, 0,
+		     CHROME_VGA(info, CHROME_VGA_MISC_READ), value,
+		     CHROME_TRACE_OLD);
 
 	CHROME_VGA(info, CHROME_VGA_MISC_WRITE) = value;
 }
@@ -86,12 +79,12 @@ void
 chrome_vga_misc_mask(struct chrome_info *info, unsigned char value,
                      unsigned char mask)
 {
-	unsigned char tmp = CHROME_VGA(info, CHROME_VGA_MISC_READ);
+	unsigned char old = CHROME_VGA(info, CHROME_VGA_MISC_READ), tmp;
 
-        IO_DEBUG_MASK("Misc", tmp, value, mask);
+	tmp = (old & ~mask) | (value & mask);
 
-	tmp &= ~mask;
-	tmp |= value & mask;
+	CHROME_TRACE(info, CHROME_TRACE_MISC, 0, old, tmp,
+		     CHROME_TRACE_OLD | CHROME_TRACE_MASK);
 
 	CHROME_VGA(info, CHROME_VGA_MISC_WRITE) = tmp;
 }
@@ -111,7 +104,9 @@ void
 chrome_vga_cr_write(struct chrome_info *info, unsigned char index,
                     unsigned char value)
 {
-        IO_DEBUG_INDEX_WRITE("CR", index, value);
+	CHROME_TRACE(info, CHROME_TRACE_CR, index,
+		     chrome_vga_cr_read(info, index), value,
+		     CHROME_TRACE_OLD);
 
 	CHROME_VGA(info, CHROME_VGA_CR_INDEX) = index;
 	CHROME_VGA(info, CHROME_VGA_CR_VALUE) = value;
@@ -121,15 +116,15 @@ void
 chrome_vga_cr_mask(struct chrome_info *info, unsigned char index,
                    unsigned char value, unsigned char mask)
 {
-	unsigned char tmp;
+	unsigned char old, tmp;
 
 	CHROME_VGA(info, CHROME_VGA_CR_INDEX) = index;
-	tmp = CHROME_VGA(info, CHROME_VGA_CR_VALUE);
+	old = CHROME_VGA(info, CHROME_VGA_CR_VALUE);
 
-        IO_DEBUG_INDEX_MASK("CR", index, tmp, value, mask);
+	tmp = (old & ~mask) | (value & mask);
 
-	tmp &= ~mask;
-	tmp |= value & mask;
+	CHROME_TRACE(info, CHROME_TRACE_CR, index, old, tmp,
+		     CHROME_TRACE_OLD | CHROME_TRACE_MASK);
 
 	CHROME_VGA(info, CHROME_VGA_CR_VALUE) = tmp;
 }
@@ -149,7 +144,9 @@ void
 chrome_vga_seq_write(struct chrome_info *info, unsigned char index,
                      unsigned char value)
 {
-        IO_DEBUG_INDEX_WRITE("SR", index, value);
+	CHROME_TRACE(info, CHROME_TRACE_SR, index,
+		     chrome_vga_seq_read(info, index), value,
+		     CHROME_TRACE_OLD);
 
 	CHROME_VGA(info, CHROME_VGA_SEQ_INDEX) = index;
 	CHROME_VGA(info, CHROME_VGA_SEQ_VALUE) = value;
@@ -159,15 +156,15 @@ void
 chrome_vga_seq_mask(struct chrome_info *info, unsigned char index,
                     unsigned char value, unsigned char mask)
 {
-	unsigned char tmp;
+	unsigned char old, tmp;
 
 	CHROME_VGA(info, CHROME_VGA_SEQ_INDEX) = index;
-	tmp = CHROME_VGA(info, CHROME_VGA_SEQ_VALUE);
+	old = CHROME_VGA(info, CHROME_VGA_SEQ_VALUE);
 
-        IO_DEBUG_INDEX_MASK("SR", index, tmp, value, mask);
+	tmp = (old & ~mask) | (value & mask);
 
-	tmp &= ~mask;
-	tmp |= value & mask;
+	CHROME_TRACE(info, CHROME_TRACE_SR, index, old, tmp,
+		     CHROME_TRACE_OLD | CHROME_TRACE_MASK);
 
 	CHROME_VGA(info, CHROME_VGA_SEQ_VALUE) = tmp;
 }
@@ -184,7 +181,9 @@ chrome_vga_enable_read(struct chrome_info *info)
 void
 chrome_vga_enable_write(struct chrome_info *info, unsigned char value)
 {
-        IO_DEBUG_WRITE("Enable", value);
+	CHROME_TRACE(info, CHROME_TRACE_ENABLE, 0,
+		     CHROME_VGA(info, CHROME_VGA_ENABLE), value,
+		     CHROME_TRACE_OLD);
 
 	CHROME_VGA(info, CHROME_VGA_ENABLE) = value;
 }
@@ -193,12 +192,12 @@ void
 chrome_vga_enable_mask(struct chrome_info *info, unsigned char value,
                        unsigned char mask)
 {
-	unsigned char tmp = CHROME_VGA(info, CHROME_VGA_ENABLE);
+	unsigned char old = CHROME_VGA(info, CHROME_VGA_ENABLE), tmp;
 
-        IO_DEBUG_MASK("Enable", tmp, value, mask);
+	tmp = (old & ~mask) | (value & mask);
 
-	tmp &= ~mask;
-	tmp |= value & mask;
+	CHROME_TRACE(info, CHROME_TRACE_ENABLE, 0, old, tmp,
+		     CHROME_TRACE_OLD | CHROME_TRACE_MASK);
 
 	CHROME_VGA(info, CHROME_VGA_ENABLE) = tmp;
 }
@@ -218,7 +217,9 @@ void
 chrome_vga_graph_write(struct chrome_info *info, unsigned char index,
                        unsigned char value)
 {
-        IO_DEBUG_INDEX_WRITE("GR", index, value);
+	CHROME_TRACE(info, CHROME_TRACE_GR, index,
+		     chrome_vga_graph_read(info, index), value,
+		     CHROME_TRACE_OLD);
 
 	CHROME_VGA(info, CHROME_VGA_GRAPH_INDEX) = index;
 	CHROME_VGA(info, CHROME_VGA_GRAPH_VALUE) = value;
@@ -228,15 +229,15 @@ void
 chrome_vga_graph_mask(struct chrome_info *info, unsigned char index,
                       unsigned char value, unsigned char mask)
 {
-	unsigned char tmp;
+	unsigned char old, tmp;
 
 	CHROME_VGA(info, CHROME_VGA_GRAPH_INDEX) = index;
-	tmp = CHROME_VGA(info, CHROME_VGA_GRAPH_VALUE);
+	old = CHROME_VGA(info, CHROME_VGA_GRAPH_VALUE);
 
-        IO_DEBUG_INDEX_MASK("GR", index, tmp, value, mask);
+	tmp = (old & ~mask) | (value & mask);
 
-	tmp &= ~mask;
-	tmp |= value & mask;
+	CHROME_TRACE(info, CHROME_TRACE_GR, index, old, tmp,
+		     CHROME_TRACE_OLD | CHROME_TRACE_MASK);
 
 	CHROME_VGA(info, CHROME_VGA_GRAPH_VALUE) = tmp;
 }
@@ -270,6 +271,9 @@ chrome_vga_attr_write(struct chrome_info *info, unsigned char index,
 {
         unsigned char stat, stored;
 
+	/* reading back would upset the flip-flop */
+	CHROME_TRACE(info, CHROME_TRACE_AR, index, 0, value, 0);
+
         stat = CHROME_VGA(info, CHROME_VGA_STAT1);
         stored = CHROME_VGA(info, CHROME_VGA_ATTR_INDEX);
 
@@ -294,7 +298,9 @@ chrome_vga_attr_mask(struct chrome_info *info, unsigned char index,
         CHROME_VGA(info, CHROME_VGA_ATTR_INDEX) = index;
 	tmp = CHROME_VGA(info, CHROME_VGA_ATTR_READ);
 
-        IO_DEBUG_INDEX_MASK("ATTR", index, tmp, value, mask);
+	CHROME_TRACE(info, CHROME_TRACE_AR, index, tmp,
+		     (tmp & ~mask) | (value & mask),
+		     CHROME_TRACE_OLD | CHROME_TRACE_MASK);
 
 	tmp &= ~mask;
 	tmp |= value & mask;
@@ -307,24 +313,39 @@ chrome_vga_attr_mask(struct chrome_info *info, unsigned char index,
         CHROME_VGA(info, CHROME_VGA_ATTR_INDEX) = stored;
 }
 
+/*
+ * Input status 1: retrace.
+ */
+unsigned char
+chrome_vga_stat1_read(struct chrome_info *info)
+{
+	return CHROME_VGA(info, CHROME_VGA_STAT1);
+}
+
 /*
  * DAC/Palette registers.
  */
 void
 chrome_vga_dac_mask_write(struct chrome_info *info, unsigned char value)
 {
+	CHROME_TRACE(info, CHROME_TRACE_DAC, 0, 0, value, 0);
+
 	CHROME_VGA(info, CHROME_VGA_DAC_MASK) = value;
 }
 
 void
 chrome_vga_dac_read_address(struct chrome_info *info, unsigned char value)
 {
+	CHROME_TRACE(info, CHROME_TRACE_DAC, 1, 0, value, 0);
+
 	CHROME_VGA(info, CHROME_VGA_DAC_READ_ADDRESS) = value;
 }
 
 void
 chrome_vga_dac_write_address(struct chrome_info *info, unsigned char value)
 {
+	CHROME_TRACE(info, CHROME_TRACE_DAC, 2, 0, value, 0);
+
 	CHROME_VGA(info, CHROME_VGA_DAC_WRITE_ADDRESS) = value;
 }
 
@@ -332,6 +353,8 @@ chrome_vga_dac_write_address(struct chrome_info *info, unsigned char value)
 void
 chrome_vga_dac_write(struct chrome_info *info, unsigned char value)
 {
+	CHROME_TRACE(info, CHROME_TRACE_DAC, 3, 0, value, 0);
+
 	CHROME_VGA(info, CHROME_VGA_DAC) = value;
 }
 
@@ -340,3 +363,22 @@ chrome_vga_dac_read(struct chrome_info *info)
 {
 	return CHROME_VGA(info, CHROME_VGA_DAC);
 }
+
+/*
+ * Engine registers: plain 32bit MMIO, below the remapped VGA registers.
+ */
+#define CHROME_MMIO(info, offset) *((volatile u32 *) ((info)->iobase + (offset)))
+
+u32
+chrome_mmio_read(struct chrome_info *info, u32 offset)
+{
+	return CHROME_MMIO(info, offset);
+}
+
+void
+chrome_mmio_write(struct chrome_info *info, u32 offset, u32 value)
+{
+	CHROME_TRACE(info, CHROME_TRACE_MMIO, offset, 0, value, 0);
+
+	CHROME_MMIO(info, offset) = value;
+}
@@ -51,10 +51,15 @@ void chrome_vga_attr_write(struct chrome_info *info, unsigned char index,
 void chrome_vga_attr_mask(struct chrome_info *info, unsigned char index,
                           unsigned char value, unsigned char mask);
 
+unsigned char chrome_vga_stat1_read(struct chrome_info *info);
+
 void chrome_vga_dac_mask_write(struct chrome_info *info, unsigned char value);
 void chrome_vga_dac_read_address(struct chrome_info *info, unsigned char value);
 void chrome_vga_dac_write_address(struct chrome_info *info, unsigned char value);
 void chrome_vga_dac_write(struct chrome_info *info, unsigned char value);
 unsigned char chrome_vga_dac_read(struct chrome_info *info);
 
+u32 chrome_mmio_read(struct chrome_info *info, u32 offset);
+void chrome_mmio_write(struct chrome_info *info, u32 offset, u32 value);
+
 #endif /* HAVE_CHROMEFB_IO_H */
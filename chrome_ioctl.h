@@ -0,0 +1,73 @@
+/*
+ * chromefb: driver for VIAs UniChrome and Chrome IGP graphics.
+ *
+ * Copyright (c) 2007 by Luc Verhaegen (libv@skynet.be)
+ *
+ * This file is subject to the terms and conditions of the GNU General
+ * Public License.  See the file COPYING in the main directory of this
+ * archive for more details.
+ *
+ */
+/*
+ * chromefb specific ioctls. Shared with userspace, so keep this free of
+ * kernel internals.
+ */
+#ifndef HAVE_CHROMEFB_IOCTL_H
+#define HAVE_CHROMEFB_IOCTL_H
+
+#include <linux/types.h>
+#include <linux/ioctl.h>
+
+/*
+ * 2D engine ownership: a client that drives the engine through the mmio
+ * mapping takes it first, and gives it back when done. Closing the device
+ * gives it back too.
+ */
+#define CHROMEFB_IOC_ENGINE_LOCK    _IO('F', 0xC0)
+#define CHROMEFB_IOC_ENGINE_UNLOCK  _IO('F', 0xC1)
+
+/*
+ * Fill or copy a rectangle, in framebuffer coordinates. With BEAM set,
+ * this first sleeps until the beam has just passed the destination,
+ * instead of waiting for a full vertical blank, so small areas that change
+ * often neither tear nor cost a frame.
+ */
+#define CHROMEFB_RECT_FILL  0x00
+#define CHROMEFB_RECT_COPY  0x01
+#define CHROMEFB_RECT_BEAM  0x02
+
+struct chromefb_rect {
+	__u32  flags;
+	__u32  dx, dy;
+	__u32  width, height;
+	__u32  sx, sy; /* copy only */
+	__u32  colour; /* fill only: as fb_fillrect, so below 16 in truecolor */
+};
+
+#define CHROMEFB_IOC_RECT  _IOW('F', 0xC2, struct chromefb_rect)
+
+/*
+ * Copy a rectangle of the framebuffer, in framebuffer coordinates and
+ * pixel format, into buffer. Lines are pitch bytes apart there, or packed
+ * when pitch is 0.
+ */
+struct chromefb_capture {
+	__u32  x, y;
+	__u32  width, height;
+	__u32  pitch;
+	__u32  pad;
+	__u64  buffer; /* user pointer */
+};
+
+#define CHROMEFB_IOC_CAPTURE  _IOW('F', 0xC3, struct chromefb_capture)
+
+/*
+ * Split screen: the bottom lines of the display show the framebuffer from
+ * offset 0, whatever the panning, while the top follows the start address
+ * as before. Keep the scrolling part below the fixed part, and pan with
+ * yoffset at or past the fixed lines. 0 turns it off. Not available with
+ * rotation or the panel scaler. Also in sysfs, as split.
+ */
+#define CHROMEFB_IOC_SPLIT  _IOW('F', 0xC4, __u32)
+
+#endif /* HAVE_CHROMEFB_IOCTL_H */
@@ -0,0 +1,216 @@
+/*
+ * chromefb: driver for VIAs UniChrome and Chrome IGP graphics.
+ *
+ * Copyright (c) 2007 by Luc Verhaegen (libv@skynet.be)
+ *
+ * This file is subject to the terms and conditions of the GNU General
+ * Public License.  See the file COPYING in the main directory of this
+ * archive for more details.
+ *
+ */
+/*
+ * Palette handling for 8bpp.
+ *
+ * setcmap only updates a shadow of the LUT. Entries that differ from what
+ * was last uploaded are tracked as a dirty range, and that range goes out
+ * in one auto-incrementing burst, at the start of the next retrace. Any
+ * number of setcmap calls before that are coalesced into that one upload.
+ */
+
+#include <linux/kernel.h>
+#include <linux/fb.h>
+#include <linux/string.h>
+#include <linux/workqueue.h>
+
+#include "chrome.h"
+#include "chrome_io.h"
+
+/*
+ * Runs from our own workqueue, as waiting for the retrace is a busy wait.
+ * The dirty range is copied out under the lock, the DAC is written without
+ * it, so that setcmap never waits for an upload with interrupts off. The
+ * DAC and AR writes only hold vga_lock, which keeps modesets out.
+ */
+static void
+chrome_lut_upload(struct chrome_info *info, int retrace)
+{
+	struct chrome_lut *lut = &info->lut;
+	unsigned long flags;
+	int i, start, end, setup;
+
+	if (retrace)
+		chrome_vblank_wait(info);
+
+	spin_lock_irqsave(&lut->lock, flags);
+
+	start = lut->dirty_start;
+	end = lut->dirty_end;
+	setup = lut->setup;
+	lut->dirty_start = 0x100;
+	lut->dirty_end = 0;
+	lut->setup = 0;
+	lut->pending = 0;
+
+	if (start < end) {
+		memcpy(lut->upload[start], lut->entries[start],
+		       (end - start) * 3);
+		lut->uploads++;
+		lut->uploaded += end - start;
+	}
+
+	spin_unlock_irqrestore(&lut->lock, flags);
+
+	spin_lock(&info->vga_lock);
+
+	if (setup) {
+		chrome_vga_dac_mask_write(info, 0xFF);
+
+		/* So, erm... What about the overscan colour then?
+		 * Are you telling me FB has no notion of that either?
+		 */
+		/* just pick 0x00, which is hopefully black*/
+		chrome_vga_attr_write(info, 0x11, 0x00);
+	}
+
+	/* 8bit LUT, see SR15 */
+	if (start < end) {
+		chrome_vga_dac_write_address(info, start);
+		for (i = start; i < end; i++) {
+			chrome_vga_dac_write(info, lut->upload[i][0]);
+			chrome_vga_dac_write(info, lut->upload[i][1]);
+			chrome_vga_dac_write(info, lut->upload[i][2]);
+		}
+	}
+
+	spin_unlock(&info->vga_lock);
+}
+
+static void
+chrome_lut_worker(struct work_struct *work)
+{
+	struct chrome_info *info =
+		container_of(work, struct chrome_info, lut_work);
+
+	chrome_lut_upload(info, 1);
+}
+
+/*
+ * Update the shadow, and get an upload going when anything changed.
+ */
+void
+chrome_lut_set(struct chrome_info *info, struct fb_cmap *cmap)
+{
+	struct chrome_lut *lut = &info->lut;
+	unsigned long flags;
+	u8 red, green, blue;
+	int i, index, queue = 0;
+
+	spin_lock_irqsave(&lut->lock, flags);
+
+	for (i = 0; i < cmap->len; i++) {
+		index = cmap->start + i;
+		red = cmap->red[i] >> 8;
+		green = cmap->green[i] >> 8;
+		blue = cmap->blue[i] >> 8;
+
+		if (test_bit(index, lut->known) &&
+		    (lut->entries[index][0] == red) &&
+		    (lut->entries[index][1] == green) &&
+		    (lut->entries[index][2] == blue))
+			continue;
+
+		lut->entries[index][0] = red;
+		lut->entries[index][1] = green;
+		lut->entries[index][2] = blue;
+		set_bit(index, lut->known);
+
+		if (index < lut->dirty_start)
+			lut->dirty_start = index;
+		if (index >= lut->dirty_end)
+			lut->dirty_end = index + 1;
+	}
+
+	if (((lut->dirty_start < lut->dirty_end) || lut->setup) &&
+	    !lut->pending) {
+		lut->pending = 1;
+		queue = 1;
+	} else if (lut->pending)
+		lut->coalesced++;
+
+	spin_unlock_irqrestore(&lut->lock, flags);
+
+	if (!queue)
+		return;
+
+	/* without a workqueue, straight away */
+	if (info->lut_wq)
+		queue_work(info->lut_wq, &info->lut_work);
+	else
+		chrome_lut_upload(info, 0);
+}
+
+/*
+ * From set_par: the LUT might have been touched by a VGA mode in between,
+ * so upload everything next time, together with mask and overscan.
+ */
+void
+chrome_lut_invalidate(struct chrome_info *info)
+{
+	struct chrome_lut *lut = &info->lut;
+	unsigned long flags;
+
+	spin_lock_irqsave(&lut->lock, flags);
+	bitmap_zero(lut->known, 0x100);
+	lut->setup = 1;
+	spin_unlock_irqrestore(&lut->lock, flags);
+}
+
+/*
+ *
+ */
+void
+chrome_lut_init(struct chrome_info *info)
+{
+	struct chrome_lut *lut = &info->lut;
+
+	spin_lock_init(&lut->lock);
+	spin_lock_init(&info->vga_lock);
+	INIT_WORK(&info->lut_work, chrome_lut_worker);
+
+	bitmap_zero(lut->known, 0x100);
+	lut->setup = 1;
+	lut->pending = 0;
+	lut->dirty_start = 0x100;
+	lut->dirty_end = 0;
+
+	info->lut_wq = create_singlethread_workqueue("chromefb_lut");
+	if (!info->lut_wq)
+		printk(KERN_WARNING "%s: no workqueue, LUT uploads will not wait"
+		       " for the retrace.\n", __func__);
+
+	chrome_debugfs_u32(info, "lut_uploads", &lut->uploads);
+	chrome_debugfs_u32(info, "lut_uploaded_entries", &lut->uploaded);
+	chrome_debugfs_u32(info, "lut_coalesced", &lut->coalesced);
+}
+
+/*
+ * Get a queued upload out of the way, before the device goes down.
+ */
+void
+chrome_lut_flush(struct chrome_info *info)
+{
+	if (info->lut_wq)
+		flush_workqueue(info->lut_wq);
+}
+
+/*
+ * No cancel_work_sync() yet: let a queued upload run out, which destroying
+ * the workqueue does.
+ */
+void
+chrome_lut_exit(struct chrome_info *info)
+{
+	if (info->lut_wq)
+		destroy_workqueue(info->lut_wq);
+	info->lut_wq = NULL;
+}
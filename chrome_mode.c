@@ -30,9 +30,17 @@
  */
 
 #include <linux/fb.h>
+#include <linux/interrupt.h>
+#include <linux/jiffies.h>
+#include <linux/delay.h>
+#include <linux/hrtimer.h>
+#include <linux/sched.h>
+#include <linux/slab.h>
+#include <linux/console.h>
 
 #include "chrome.h"
 #include "chrome_io.h"
+#include "chrome_pll.h"
 
 /*
  * Force some VGA alignments on the mode.
@@ -57,7 +65,6 @@ chrome_crtc1_mode_valid(struct chrome_info *info, struct fb_var_screeninfo *mode
 {
 	__u32 total, blank_start, sync_start, sync_end, blank_end;
 	__u32 right_overscan, left_overscan, upper_overscan, lower_overscan;
-	__u32 temp, bytes_per_pixel;
 
 	/* Set up for Horizontal timing */
 	blank_start = mode->xres;
@@ -144,6 +151,17 @@ chrome_crtc1_mode_valid(struct chrome_info *info, struct fb_var_screeninfo *mode
 		return -EINVAL;
 	}
 
+	return 0;
+}
+
+/*
+ * What the CRTC fetches from the framebuffer, rather than what it sends out.
+ */
+static int
+chrome_crtc1_fb_valid(struct chrome_info *info, struct fb_var_screeninfo *mode)
+{
+	__u32 temp, bytes_per_pixel;
+
 	/* Check Virtual */
 	if (mode->bits_per_pixel < 24) /* don't do an extensive check here */
 		bytes_per_pixel = mode->bits_per_pixel / 8;
@@ -152,38 +170,24 @@ chrome_crtc1_mode_valid(struct chrome_info *info, struct fb_var_screeninfo *mode
 
 	/* We can't always pan all the way */
 	/* Calculate the maximum offset */
-	temp = mode->xres_virtual * bytes_per_pixel;
-	temp *= mode->yres_virtual - mode->yres_virtual + 1;
-	temp -= (mode->xres - 1) * bytes_per_pixel;
-
-	switch (info->id) {
-	case PCI_CHIP_VT3122:
-		if (temp < 0x1FFFFFF)
-			break;
-		printk(KERN_WARNING "Virtual resolution exceeds panning limit");
-		return -EINVAL;
-	case PCI_CHIP_VT7205:
-	case PCI_CHIP_VT3108:
-		if (temp < 0x7FFFFFF) /* equals MAX FB size */
-			break;
-		printk(KERN_WARNING "Virtual resolution exceeds panning limit");
-		return -EINVAL;
-	default:
-		printk(KERN_WARNING "%s: unsupported chip: 0x%4X\n",
-		       __func__, info->id);
+	temp = (mode->yres_virtual - mode->yres) * mode->xres_virtual;
+	temp += mode->xres_virtual - mode->xres;
+	temp *= bytes_per_pixel;
+	if (temp > info->chip->pan_max) {
+		printk(KERN_WARNING "Virtual resolution exceeds panning limit.\n");
 		return -EINVAL;
 	}
 
 	/* Offset */
 	temp = mode->xres_virtual * bytes_per_pixel;
-	if (temp > 16368) {
+	if (temp > info->chip->pitch_max) {
 		printk(KERN_WARNING "Offset too wide.\n");
 		return -EINVAL;
 	}
 
-	/* Fetch count -- caught by xres check higher up */
+	/* Fetch count */
 	temp = mode->xres * bytes_per_pixel;
-	if (temp > 16376) {
+	if (temp > info->chip->fetch_max) {
 		printk(KERN_WARNING "Fetch count too wide.\n");
 		return -EINVAL;
 	}
@@ -191,6 +195,70 @@ chrome_crtc1_mode_valid(struct chrome_info *info, struct fb_var_screeninfo *mode
 	return 0;
 }
 
+/*
+ * With a 90 or 270 degree rotation, xres and yres are what the console and
+ * userspace see, while the timing fields still describe the monitor. This
+ * gives the mode as the CRTC has to scan it out.
+ */
+static void
+chrome_mode_physical(struct fb_var_screeninfo *mode,
+                     struct fb_var_screeninfo *physical)
+{
+	*physical = *mode;
+
+	if ((mode->rotate == FB_ROTATE_CW) || (mode->rotate == FB_ROTATE_CCW)) {
+		physical->xres = mode->yres;
+		physical->yres = mode->xres;
+	}
+
+	physical->xres_virtual = physical->xres;
+	physical->yres_virtual = physical->yres;
+	physical->xoffset = 0;
+	physical->yoffset = 0;
+	physical->rotate = FB_ROTATE_UR;
+}
+
+/*
+ * Panel scaler: the CRTC runs the output timing, and fetches a framebuffer
+ * that is no bigger than that, which gets stretched. The var then carries
+ * the output timing.
+ */
+static int
+chrome_mode_scaler_valid(struct chrome_info *info,
+			 struct fb_var_screeninfo *mode)
+{
+	struct fb_var_screeninfo *timing = &info->mode_output;
+	int ret;
+
+	if (mode->rotate) {
+		printk(KERN_WARNING "No rotation with the scaler.\n");
+		return -EINVAL;
+	}
+
+	chrome_vga_align(mode);
+
+	if ((mode->xres > timing->xres) || (mode->yres > timing->yres)) {
+		printk(KERN_WARNING "%dx%d does not fit the %dx%d output.\n",
+		       mode->xres, mode->yres, timing->xres, timing->yres);
+		return -EINVAL;
+	}
+
+	ret = chrome_crtc1_fb_valid(info, mode);
+	if (ret)
+		return ret;
+
+	mode->pixclock = timing->pixclock;
+	mode->left_margin = timing->left_margin;
+	mode->right_margin = timing->right_margin;
+	mode->upper_margin = timing->upper_margin;
+	mode->lower_margin = timing->lower_margin;
+	mode->hsync_len = timing->hsync_len;
+	mode->vsync_len = timing->vsync_len;
+	mode->sync = timing->sync;
+
+	return 0;
+}
+
 /*
  *
  */
@@ -201,11 +269,38 @@ chrome_mode_valid(struct chrome_info *info, struct fb_var_screeninfo *mode)
 
 	DBG(__func__);
 
+	if (info->scale)
+		return chrome_mode_scaler_valid(info, mode);
+
+	/* Validate what the monitor gets to see, then hand back the aligned
+	 * values in the rotated geometry. */
+	if (mode->rotate) {
+		struct fb_var_screeninfo physical;
+
+		chrome_mode_physical(mode, &physical);
+
+		ret = chrome_mode_valid(info, &physical);
+		if (ret)
+			return ret;
+
+		if ((mode->rotate == FB_ROTATE_CW) ||
+		    (mode->rotate == FB_ROTATE_CCW))
+			mode->yres = physical.xres;
+		else
+			mode->xres = physical.xres;
+		mode->xres_virtual = mode->xres;
+		mode->yres_virtual = mode->yres;
+		mode->right_margin = physical.right_margin;
+		mode->hsync_len = physical.hsync_len;
+		mode->left_margin = physical.left_margin;
+		return 0;
+	}
+
 	chrome_vga_align(mode);
 
 	/* Clock */
 	clock = PICOS2KHZ(mode->pixclock); /* idiots. */
-	if ((clock < 20000) || (clock > 200000)) {
+	if ((clock < CHROME_PLL_CLOCK_MIN) || (clock > CHROME_PLL_CLOCK_MAX)) {
 		printk(KERN_WARNING "Dotclock %dkHz is out of range.\n", clock);
 		return -EINVAL;
 	}
@@ -215,6 +310,10 @@ chrome_mode_valid(struct chrome_info *info, struct fb_var_screeninfo *mode)
 	if (ret)
 		return ret;
 
+	ret = chrome_crtc1_fb_valid(info, mode);
+	if (ret)
+		return ret;
+
 	/* Outputs */
 	/* Here we also check whether a CRT can handle this timing. */
 
@@ -223,20 +322,182 @@ chrome_mode_valid(struct chrome_info *info, struct fb_var_screeninfo *mode)
 
 /*
  *
+ * Register images.
+ *
+ */
+/*
+ * Multiple masked writes to the same register are folded into one entry,
+ * at the position of the first write.
+ */
+void
+chrome_mode_reg(struct chrome_mode_regs *regs, unsigned char bank,
+                unsigned char index, unsigned char value, unsigned char mask)
+{
+	struct chrome_reg *reg;
+	int i;
+
+	for (i = 0; i < min(regs->count, CHROME_MODE_REGS_MAX); i++) {
+		reg = &regs->regs[i];
+		if ((reg->bank == bank) && (reg->index == index)) {
+			reg->value = (reg->value & ~mask) | (value & mask);
+			reg->mask |= mask;
+			return;
+		}
+	}
+
+	/* overflow is caught by chrome_mode_build() */
+	if (regs->count < CHROME_MODE_REGS_MAX) {
+		reg = &regs->regs[regs->count];
+		reg->bank = bank;
+		reg->index = index;
+		reg->value = value & mask;
+		reg->mask = mask;
+	}
+	regs->count++;
+}
+
+/*
+ *
+ */
+static void
+chrome_mode_reg_write(struct chrome_info *info, struct chrome_reg *reg)
+{
+	switch (reg->bank) {
+	case CHROME_REG_MISC:
+		chrome_vga_misc_write(info, reg->value);
+		break;
+	case CHROME_REG_SR:
+		if (reg->mask == 0xFF)
+			chrome_vga_seq_write(info, reg->index, reg->value);
+		else
+			chrome_vga_seq_mask(info, reg->index, reg->value,
+					    reg->mask);
+		break;
+	case CHROME_REG_CR:
+		if (reg->mask == 0xFF)
+			chrome_vga_cr_write(info, reg->index, reg->value);
+		else
+			chrome_vga_cr_mask(info, reg->index, reg->value,
+					   reg->mask);
+		break;
+	case CHROME_REG_GR:
+		if (reg->mask == 0xFF)
+			chrome_vga_graph_write(info, reg->index, reg->value);
+		else
+			chrome_vga_graph_mask(info, reg->index, reg->value,
+					      reg->mask);
+		break;
+	case CHROME_REG_AR:
+		if (reg->mask == 0xFF)
+			chrome_vga_attr_write(info, reg->index, reg->value);
+		else
+			chrome_vga_attr_mask(info, reg->index, reg->value,
+					     reg->mask);
+		break;
+	default:
+		break;
+	}
+}
+
+/*
+ * fetch count: 16368Bytes: 4092pixels for 24/32bpp
+ */
+static void
+chrome_mode_fetch(struct chrome_mode_regs *regs, struct fb_var_screeninfo *mode)
+{
+	__u16 temp, bytes_per_pixel;
+
+	if (mode->bits_per_pixel < 24)
+		bytes_per_pixel = mode->bits_per_pixel / 8;
+	else
+		bytes_per_pixel = 4;
+
+	temp = mode->xres * bytes_per_pixel / 8;
+
+	/* Make sure that this is 32byte aligned */
+	if (temp & 0x03) {
+		temp += 0x03;
+		temp &= ~0x03;
+	}
+	chrome_reg_sr(regs, 0x1C, (temp >> 1) & 0xFF, 0xFF);
+	chrome_reg_sr(regs, 0x1D, temp >> 9, 0x03);
+}
+
+/*
+ * Scaling factors for the panel scaler, with CR79 bit 0 as the enable.
+ *
+ * CLE266 and KM400 only have 10bit factors, in CR77, CR78 and CR79, with
+ * the horizontal and vertical enables in CR79 bits 1 and 2. Later chips
+ * have 12bit horizontal and 11bit vertical factors, which spill into CR9F
+ * and CR79 bit 3, and enable each direction in CRA2 instead.
  */
 static void
-chrome_mode_crtc_primary(struct chrome_info *info, struct fb_var_screeninfo *mode)
+chrome_mode_scaler(struct chrome_info *info, struct chrome_mode_regs *regs,
+		   struct fb_var_screeninfo *mode,
+		   struct fb_var_screeninfo *timing)
+{
+	unsigned char cr79 = 0, cra2 = 0;
+	__u32 factor;
+
+	if (!(info->chip->caps & CHROME_CAP_SCALER_FINE)) {
+		if (mode->xres < timing->xres) {
+			factor = ((mode->xres - 1) * 1024) / (timing->xres - 1);
+			chrome_reg_cr(regs, 0x77, factor, 0xFF);
+			cr79 |= ((factor >> 8) & 0x03) << 4;
+			cr79 |= 0x03;
+		}
+
+		if (mode->yres < timing->yres) {
+			factor = ((mode->yres - 1) * 1024) / (timing->yres - 1);
+			chrome_reg_cr(regs, 0x78, factor, 0xFF);
+			cr79 |= ((factor >> 8) & 0x03) << 6;
+			cr79 |= 0x05;
+		}
+
+		chrome_reg_cr(regs, 0x79, cr79, 0xF7);
+		return;
+	}
+
+	if (mode->xres < timing->xres) {
+		factor = ((mode->xres - 1) * 4096) / (timing->xres - 1);
+		chrome_reg_cr(regs, 0x9F, factor, 0x03);
+		chrome_reg_cr(regs, 0x77, factor >> 2, 0xFF);
+		cr79 |= ((factor >> 10) & 0x03) << 4;
+		cra2 |= 0xC0;
+	}
+
+	if (mode->yres < timing->yres) {
+		factor = ((mode->yres - 1) * 2048) / (timing->yres - 1);
+		chrome_reg_cr(regs, 0x78, factor >> 1, 0xFF);
+		cr79 |= (factor & 0x01) << 3;
+		cr79 |= ((factor >> 9) & 0x03) << 6;
+		cra2 |= 0x08;
+	}
+
+	/* factors from the registers, and enable */
+	if (cra2)
+		chrome_reg_cr(regs, 0x79, cr79 | 0x03, 0xFF);
+	else
+		chrome_reg_cr(regs, 0x79, 0x00, 0x01);
+	chrome_reg_cr(regs, 0xA2, cra2, 0xC8);
+}
+
+/*
+ *
+ */
+static void
+chrome_mode_crtc_primary(struct chrome_mode_regs *regs,
+			 struct fb_var_screeninfo *mode)
 {
 	__u32 blank_start, blank_end, sync_start, sync_end, total;
 	__u16 temp, bytes_per_pixel;
 
 	/* Unlock all registers */
-	chrome_vga_cr_mask(info, 0x11, 0x00, 0x80); /* modify starting address */
-	chrome_vga_cr_mask(info, 0x03, 0x80, 0x80); /* enable vsync access */
-	chrome_vga_cr_mask(info, 0x47, 0x00, 0x01); /* unlock CRT registers */
+	chrome_reg_cr(regs, 0x11, 0x00, 0x80); /* modify starting address */
+	chrome_reg_cr(regs, 0x03, 0x80, 0x80); /* enable vsync access */
+	chrome_reg_cr(regs, 0x47, 0x00, 0x01); /* unlock CRT registers */
 
-	/* stop sequencer */
-	chrome_vga_seq_write(info, 0x00, 0x00);
+	/* sequencer reset: chrome_mode_commit() does that around the image */
 
 	/* set up misc register */
 	temp = 0x23;
@@ -245,53 +506,53 @@ chrome_mode_crtc_primary(struct chrome_info *info, struct fb_var_screeninfo *mod
 	if (!(mode->sync & FB_SYNC_VERT_HIGH_ACT))
 		temp |= 0x80;
 	temp |= 0x0C; /* Undefined/external clock */
-	chrome_vga_misc_write(info, temp);
+	chrome_reg_misc(regs, temp);
 
 	/* Sequence registers */
-	chrome_vga_seq_write(info, 0x01, 0xDF);
+	chrome_reg_sr(regs, 0x01, 0xDF, 0xFF);
 
 	/* 8bit lut / 80 text columns / wrap-around / extended mode */
-	chrome_vga_seq_mask(info, 0x15, 0xA2, 0xE2);
+	chrome_reg_sr(regs, 0x15, 0xA2, 0xE2);
 
 	/* 555/565 -- bpp */
 	switch (mode->bits_per_pixel) {
 	case 8:
-		chrome_vga_seq_mask(info, 0x15, 0x00, 0x1C);
+		chrome_reg_sr(regs, 0x15, 0x00, 0x1C);
 		break;
 	case 16:
-		chrome_vga_seq_mask(info, 0x15, 0x14, 0x1C);
+		chrome_reg_sr(regs, 0x15, 0x14, 0x1C);
 		break;
 	case 24:
 	case 32:
 	default: /* silently continue on - should've been caught earlier */
-		chrome_vga_seq_mask(info, 0x15, 0x0C, 0x1C);
+		chrome_reg_sr(regs, 0x15, 0x0C, 0x1C);
 		break;
 	}
 
 	/* Set up graphics registers -- do we really need to? */
-	chrome_vga_graph_write(info, 0x00, 0x00);
-	chrome_vga_graph_write(info, 0x01, 0x00);
-	chrome_vga_graph_write(info, 0x02, 0x00);
-	chrome_vga_graph_write(info, 0x03, 0x00);
-	chrome_vga_graph_write(info, 0x04, 0x00);
-	chrome_vga_graph_write(info, 0x05, 0x40);
-	chrome_vga_graph_write(info, 0x06, 0x05);
-	chrome_vga_graph_write(info, 0x07, 0x0F);
-	chrome_vga_graph_write(info, 0x08, 0xFF);
+	chrome_reg_gr(regs, 0x00, 0x00, 0xFF);
+	chrome_reg_gr(regs, 0x01, 0x00, 0xFF);
+	chrome_reg_gr(regs, 0x02, 0x00, 0xFF);
+	chrome_reg_gr(regs, 0x03, 0x00, 0xFF);
+	chrome_reg_gr(regs, 0x04, 0x00, 0xFF);
+	chrome_reg_gr(regs, 0x05, 0x40, 0xFF);
+	chrome_reg_gr(regs, 0x06, 0x05, 0xFF);
+	chrome_reg_gr(regs, 0x07, 0x0F, 0xFF);
+	chrome_reg_gr(regs, 0x08, 0xFF, 0xFF);
 
 	/* Null the offsets */
-	chrome_vga_graph_write(info, 0x20, 0x00);
-	chrome_vga_graph_write(info, 0x21, 0x00);
-	chrome_vga_graph_write(info, 0x22, 0x00);
+	chrome_reg_gr(regs, 0x20, 0x00, 0xFF);
+	chrome_reg_gr(regs, 0x21, 0x00, 0xFF);
+	chrome_reg_gr(regs, 0x22, 0x00, 0xFF);
 
 	/* Attribute registers */
 	for (temp = 0; temp < 0x10; temp++)
-		chrome_vga_attr_write(info, temp, temp);
-	chrome_vga_attr_write(info, 0x10, 0x41);
-	chrome_vga_attr_write(info, 0x11, 0xFF);
-	chrome_vga_attr_write(info, 0x12, 0x0F);
-	chrome_vga_attr_write(info, 0x13, 0x00);
-	chrome_vga_attr_write(info, 0x14, 0x00);
+		chrome_reg_ar(regs, temp, temp, 0xFF);
+	chrome_reg_ar(regs, 0x10, 0x41, 0xFF);
+	chrome_reg_ar(regs, 0x11, 0xFF, 0xFF);
+	chrome_reg_ar(regs, 0x12, 0x0F, 0xFF);
+	chrome_reg_ar(regs, 0x13, 0x00, 0xFF);
+	chrome_reg_ar(regs, 0x14, 0x00, 0xFF);
 
 	/* Finally, the good stuff, the CRTC */
 	/* Do the FB dance first. */
@@ -302,34 +563,35 @@ chrome_mode_crtc_primary(struct chrome_info *info, struct fb_var_screeninfo *mod
 	total = blank_end;
 
 	/* horizontal total : 4100 */
+	regs->htotal = total;
 	temp = (total >> 3) - 5;
-	chrome_vga_cr_write(info, 0x00, temp & 0xFF);
-	chrome_vga_cr_mask(info, 0x36, temp >> 5, 0x08);
+	chrome_reg_cr(regs, 0x00, temp & 0xFF, 0xFF);
+	chrome_reg_cr(regs, 0x36, temp >> 5, 0x08);
 
 	/* horizontal address : 2048 */
 	temp = (mode->xres >> 3) - 1;
-	chrome_vga_cr_write(info, 0x01, temp & 0xFF);
+	chrome_reg_cr(regs, 0x01, temp & 0xFF, 0xFF);
 
 	/* horizontal blanking start : 2048 */
 	temp = (blank_start >> 3) - 1;
-	chrome_vga_cr_write(info, 0x02, temp & 0xFF);
+	chrome_reg_cr(regs, 0x02, temp & 0xFF, 0xFF);
 
 	/* horizontal blanking end : start + 1025 */
 	temp = (blank_end >> 3) - 1;
-	chrome_vga_cr_mask(info, 0x03, temp, 0x1F);
-	chrome_vga_cr_mask(info, 0x05, temp << 2, 0x80);
-	chrome_vga_cr_mask(info, 0x33, temp >> 1, 0x20);
+	chrome_reg_cr(regs, 0x03, temp, 0x1F);
+	chrome_reg_cr(regs, 0x05, temp << 2, 0x80);
+	chrome_reg_cr(regs, 0x33, temp >> 1, 0x20);
 
 	/* CrtcHSkew ??? */
 
 	/* horizontal sync start : 4095 */
 	temp = sync_start >> 3;
-	chrome_vga_cr_write(info, 0x04, temp & 0xFF);
-	chrome_vga_cr_mask(info, 0x33, temp >> 4, 0x10);
+	chrome_reg_cr(regs, 0x04, temp & 0xFF, 0xFF);
+	chrome_reg_cr(regs, 0x33, temp >> 4, 0x10);
 
 	/* horizontal sync end : start + 256 */
 	temp = sync_end >> 3;
-	chrome_vga_cr_mask(info, 0x05, temp, 0x1F);
+	chrome_reg_cr(regs, 0x05, temp, 0x1F);
 
 	/* Dance again for Vertical timing */
 	blank_start = mode->yres;
@@ -339,53 +601,50 @@ chrome_mode_crtc_primary(struct chrome_info *info, struct fb_var_screeninfo *mod
 	total = blank_end;
 
 	/* vertical total : 2049 */
+	regs->vtotal = total;
+	regs->vsync_start = sync_start;
 	temp = total - 2;
-	chrome_vga_cr_write(info, 0x06, temp & 0xFF);
-	chrome_vga_cr_mask(info, 0x07, temp >> 8, 0x01);
-	chrome_vga_cr_mask(info, 0x07, temp >> 4, 0x20);
-	chrome_vga_cr_mask(info, 0x35, temp >> 10, 0x01);
+	chrome_reg_cr(regs, 0x06, temp & 0xFF, 0xFF);
+	chrome_reg_cr(regs, 0x07, temp >> 8, 0x01);
+	chrome_reg_cr(regs, 0x07, temp >> 4, 0x20);
+	chrome_reg_cr(regs, 0x35, temp >> 10, 0x01);
 
 	/* vertical address : 2048 */
-	temp = mode->xres - 1;
-	chrome_vga_cr_write(info, 0x12, temp & 0xFF);
-	chrome_vga_cr_mask(info, 0x07, temp >> 7, 0x02);
-	chrome_vga_cr_mask(info, 0x07, temp >> 3, 0x40);
-	chrome_vga_cr_mask(info, 0x35, temp >> 8, 0x04);
+	temp = mode->yres - 1;
+	chrome_reg_cr(regs, 0x12, temp & 0xFF, 0xFF);
+	chrome_reg_cr(regs, 0x07, temp >> 7, 0x02);
+	chrome_reg_cr(regs, 0x07, temp >> 3, 0x40);
+	chrome_reg_cr(regs, 0x35, temp >> 8, 0x04);
 
 	/* vertical sync start : 2047 */
 	temp = sync_start;
-	chrome_vga_cr_write(info, 0x10, temp & 0xFF);
-	chrome_vga_cr_mask(info, 0x07, temp >> 6, 0x04);
-	chrome_vga_cr_mask(info, 0x07, temp >> 2, 0x80);
-	chrome_vga_cr_mask(info, 0x35, temp >> 9, 0x02);
+	chrome_reg_cr(regs, 0x10, temp & 0xFF, 0xFF);
+	chrome_reg_cr(regs, 0x07, temp >> 6, 0x04);
+	chrome_reg_cr(regs, 0x07, temp >> 2, 0x80);
+	chrome_reg_cr(regs, 0x35, temp >> 9, 0x02);
 
 	/* vertical sync end : start + 16 -- other bits someplace? */
-	chrome_vga_cr_mask(info, 0x11, sync_end, 0x0F);
+	chrome_reg_cr(regs, 0x11, sync_end, 0x0F);
 
-	/* line compare: We are not doing splitscreen so 0x3FFF */
-	chrome_vga_cr_write(info, 0x18, 0xFF);
-	chrome_vga_cr_mask(info, 0x07, 0x10, 0x10);
-	chrome_vga_cr_mask(info, 0x09, 0x40, 0x40);
-	chrome_vga_cr_mask(info, 0x33, 0x07, 0x06);
-	chrome_vga_cr_mask(info, 0x35, 0x10, 0x10);
+	/* line compare: see chrome_mode_finish() */
 
 	/* zero Maximum scan line */
-	chrome_vga_cr_mask(info, 0x09, 0x00, 0x1F);
-	chrome_vga_cr_write(info, 0x14, 0x00);
+	chrome_reg_cr(regs, 0x09, 0x00, 0x1F);
+	chrome_reg_cr(regs, 0x14, 0x00, 0xFF);
 
 	/* vertical blanking start : 2048 */
 	temp = blank_start - 1;
-	chrome_vga_cr_write(info, 0x15, temp & 0xFF);
-	chrome_vga_cr_mask(info, 0x07, temp >> 5, 0x08);
-	chrome_vga_cr_mask(info, 0x09, temp >> 4, 0x20);
-	chrome_vga_cr_mask(info, 0x35, temp >> 7, 0x08);
+	chrome_reg_cr(regs, 0x15, temp & 0xFF, 0xFF);
+	chrome_reg_cr(regs, 0x07, temp >> 5, 0x08);
+	chrome_reg_cr(regs, 0x09, temp >> 4, 0x20);
+	chrome_reg_cr(regs, 0x35, temp >> 7, 0x08);
 
 	/* vertical blanking end : start + 257 */
 	temp = blank_end - 1;
-	chrome_vga_cr_write(info, 0x16, temp & 0xFF);
+	chrome_reg_cr(regs, 0x16, temp & 0xFF, 0xFF);
 
 	/* vga row scan preset */
-	chrome_vga_cr_write(info, 0x08, 0x00);
+	chrome_reg_cr(regs, 0x08, 0x00, 0xFF);
 
 	if (mode->bits_per_pixel < 24)
 		bytes_per_pixel = mode->bits_per_pixel / 8;
@@ -399,22 +658,31 @@ chrome_mode_crtc_primary(struct chrome_info *info, struct fb_var_screeninfo *mod
 		temp += 0x03;
 		temp &= ~0x03;
 	}
-	chrome_vga_cr_write(info, 0x13, temp & 0xFF);
-	chrome_vga_cr_mask(info, 0x35, temp >> 3, 0xE0);
+	chrome_reg_cr(regs, 0x13, temp & 0xFF, 0xFF);
+	chrome_reg_cr(regs, 0x35, temp >> 3, 0xE0);
 
-	/* fetch count: 16368Bytes: 4092pixels for 24/32bpp */
-	temp = mode->xres * bytes_per_pixel / 8;
-	/* Make sure that this is 32byte aligned */
-	if (temp & 0x03) {
-		temp += 0x03;
-		temp &= ~0x03;
-	}
-	chrome_vga_seq_write(info, 0x1C, (temp >> 1) & 0xFF);
-	chrome_vga_seq_mask(info, 0x1D, temp >> 9, 0x03);
+	chrome_mode_fetch(regs, mode);
 
 	/* some leftovers */
-	chrome_vga_cr_mask(info, 0x32, 0, 0xFF); /* Mode control */
-	chrome_vga_cr_mask(info, 0x33, 0, 0x48); /* HSync control */
+	chrome_reg_cr(regs, 0x32, 0, 0xFF); /* Mode control */
+	chrome_reg_cr(regs, 0x33, 0, 0x48); /* HSync control */
+}
+
+/*
+ * Start address, in units of 2 bytes.
+ */
+__u32
+chrome_mode_start(struct fb_var_screeninfo *mode, __u32 line_length)
+{
+	__u32 base;
+
+	base = mode->yoffset * line_length;
+	if (mode->bits_per_pixel < 24)
+		base += mode->xoffset * (mode->bits_per_pixel / 8);
+	else
+		base += mode->xoffset * 4;
+
+	return base >> 1;
 }
 
 /*
@@ -426,26 +694,9 @@ chrome_mode_crtc_primary(struct chrome_info *info, struct fb_var_screeninfo *mod
  *
  */
 static void
-chrome_pll_primary_set(struct chrome_info *info, __u32 clock)
+chrome_pll_primary_set(struct chrome_info *info, __u32 pll)
 {
-	printk(KERN_DEBUG "%s to 0x%x\n", __func__, clock);
-
-	switch (info->id) {
-	case PCI_CHIP_VT3122:
-	case PCI_CHIP_VT7205:
-		chrome_vga_seq_write(info, 0x46, clock >> 8);
-		chrome_vga_seq_write(info, 0x47, clock & 0xFF);
-		break;
-	case PCI_CHIP_VT3108:
-		chrome_vga_seq_write(info, 0x44, clock >> 16);
-		chrome_vga_seq_write(info, 0x45, (clock >> 8) & 0xFF);
-		chrome_vga_seq_write(info, 0x46, clock & 0xFF);
-		break;
-	default:
-		printk(KERN_ERR "%s: Unsupported chipset 0x%04X\n",
-		       __func__, info->id);
-		return;
-	}
+	info->chip->pll_set(info, pll);
 
 	chrome_vga_seq_mask(info, 0x40, 0x02, 0x02);
 	chrome_vga_seq_mask(info, 0x40, 0x00, 0x02);
@@ -453,192 +704,441 @@ chrome_pll_primary_set(struct chrome_info *info, __u32 clock)
 	chrome_vga_misc_mask(info, 0x00, 0x00); /* poke */
 }
 
+/*
+ * Inverse of chrome_pll_primary_set(): returns the current dotclock in kHz.
+ */
+static int
+chrome_pll_primary_get(struct chrome_info *info)
+{
+	return info->chip->pll_clock(info->chip->pll_get(info));
+}
+
 /*
  *
  */
-static __u32
-vt3122_pll_generate_best(int clock, int shift, int min_div, int max_div,
-                         int *best_diff)
+__u32
+chrome_pll_generate(struct chrome_info *info, int clock)
 {
-	__u32 pll = 0;
-	__u8 pll_shift;
-	int div, mult, diff;
+	__u32 pll;
+	int diff;
 
-        DBG(__func__);
+	DBG(__func__);
 
-	switch (shift) {
-	case 4:
-		pll_shift = 0x80;
-		break;
-	case 2:
-		pll_shift = 0x40;
-		break;
-	default:
-		pll_shift = 0x00;
-		break;
+	pll = info->chip->pll_generate(clock, &diff);
+
+	CHROME_DEBUG("%s: pll: 0x%06X (%d off from %d)\n",
+		     __func__, pll, diff, clock);
+	return pll;
+}
+
+/*
+ * Wait for the start of the next vertical retrace. Gives up after two
+ * frames worth of time, for when the CRTC is not running.
+ */
+int
+chrome_vblank_wait(struct chrome_info *info)
+{
+	unsigned long timeout = jiffies + msecs_to_jiffies(40) + 1;
+
+	/* Let a retrace that is already running pass. */
+	while (chrome_vga_stat1_read(info) & 0x08)
+		if (time_after(jiffies, timeout))
+			return -ETIMEDOUT;
+
+	while (!(chrome_vga_stat1_read(info) & 0x08))
+		if (time_after(jiffies, timeout))
+			return -ETIMEDOUT;
+
+	info->scan_stamp = chrome_time_ns();
+	return 0;
+}
+
+/*
+ *
+ * Scanline.
+ *
+ */
+/*
+ * There is no readable line counter, so the current scanline is estimated
+ * from the last retrace start seen and the line time of the programmed PLL.
+ * The estimate drifts with the accuracy of the reference, so it gets
+ * resynchronised against the retrace once it gets old.
+ */
+#define CHROME_SCAN_RESYNC_NS 1000000000
+
+/* how far off an old estimate can be, well above what the PLL drifts */
+#define CHROME_SCAN_DRIFT_NS 1000000
+
+/* lines to stay clear of the beam, to soak up drift and write time */
+#define CHROME_SCAN_MARGIN 4
+
+/*
+ * From the mode commit.
+ */
+static void
+chrome_scanline_timing(struct chrome_info *info, struct chrome_mode_regs *regs)
+{
+	int clock = info->chip->pll_clock(regs->pll);
+	u64 temp;
+
+	info->scan_stamp = 0;
+	info->scan_total = regs->vtotal;
+	info->scan_sync = regs->vsync_start;
+
+	if (clock <= 0) {
+		info->scan_line_ps = 0;
+		return;
 	}
 
-	for (div = min_div; div <= max_div; div++) {
-		mult = clock * div * shift * 1000;
-		mult /= 14318;
-		mult += 500; /* round */
-		mult /= 1000;
+	/* kHz to ps per line */
+	temp = (u64) regs->htotal * 1000000000;
+	do_div(temp, clock);
+	info->scan_line_ps = temp;
+}
 
-		if (mult < 129) {
-			diff = clock - mult * 14318 / div / shift;
+/*
+ * From set_par, when the firmware mode is kept and nothing gets committed:
+ * the same, from the mode as read back.
+ */
+void
+chrome_scanline_mode(struct chrome_info *info, struct fb_var_screeninfo *mode)
+{
+	info->scan_stamp = 0;
+	info->scan_total = mode->yres + mode->lower_margin + mode->vsync_len +
+		mode->upper_margin;
+	info->scan_sync = mode->yres + mode->lower_margin;
+	info->scan_line_ps = mode->pixclock * (mode->xres + mode->right_margin +
+					       mode->hsync_len + mode->left_margin);
+}
 
-			if (diff < 0)
-				diff *= -1;
+/*
+ * How long the beam takes for a number of lines.
+ */
+static u32
+chrome_scanline_ns(struct chrome_info *info, int lines)
+{
+	u64 temp = (u64) info->scan_line_ps * lines;
 
-			if (diff < *best_diff) {
-				*best_diff = diff;
-				pll = ((pll_shift | div) << 8) | mult;
-			}
-		}
+	do_div(temp, 1000);
+	return temp;
+}
+
+/*
+ * Returns the scanline the CRTC is at, or -1 when it cannot be known, or
+ * when the estimate is too old to be trusted.
+ */
+int
+chrome_scanline(struct chrome_info *info)
+{
+	u64 elapsed, temp;
+	u32 frame_ns, offset;
+	int line;
+
+	if (!info->scan_line_ps || !info->scan_stamp)
+		return -1;
+
+	elapsed = chrome_time_ns() - info->scan_stamp;
+	if (elapsed > CHROME_SCAN_RESYNC_NS)
+		return -1;
+
+	frame_ns = chrome_scanline_ns(info, info->scan_total);
+	if (!frame_ns)
+		return -1;
+
+	offset = do_div(elapsed, frame_ns);
+
+	temp = (u64) offset * 1000;
+	do_div(temp, info->scan_line_ps);
+
+	line = info->scan_sync + (int) temp;
+	if (line >= info->scan_total)
+		line -= info->scan_total;
+	return line;
+}
+
+/*
+ * Sleep through a stretch of the frame. The last couple of lines are not
+ * worth a trip through the scheduler.
+ */
+static void
+chrome_scanline_sleep(struct chrome_info *info, u32 ns)
+{
+	ktime_t expires;
+
+	if (ns > chrome_scanline_ns(info, 2)) {
+		expires = ktime_set(0, ns);
+		set_current_state(TASK_UNINTERRUPTIBLE);
+		schedule_hrtimeout(&expires, HRTIMER_MODE_REL);
+	} else
+		ndelay(ns);
+}
+
+/*
+ * Get a fresh retrace stamp. An old one still tells when the next retrace
+ * is due, give or take the drift, so only the last bit before it gets
+ * spun for. Without any stamp, there is nothing to do but spin.
+ */
+static int
+chrome_scanline_resync(struct chrome_info *info)
+{
+	u64 elapsed;
+	u32 frame_ns, offset;
+
+	frame_ns = chrome_scanline_ns(info, info->scan_total);
+	if (!frame_ns)
+		return -1;
+
+	if (info->scan_stamp) {
+		elapsed = chrome_time_ns() - info->scan_stamp;
+		offset = do_div(elapsed, frame_ns);
+
+		if ((frame_ns - offset) > CHROME_SCAN_DRIFT_NS)
+			chrome_scanline_sleep(info, frame_ns - offset -
+					      CHROME_SCAN_DRIFT_NS);
 	}
 
-	return pll;
+	return chrome_vblank_wait(info);
 }
 
 /*
- * This might seem nasty and ugly, but it's the best solution given the crappy
- * limitations the VT3122 pll has.
+ * Wait until the beam has just left lines top to bottom behind, so that it
+ * has the rest of the frame to come back round. A draw started then is
+ * taken to be done before the beam has scanned as many lines as it covers;
+ * when there is not that much of the frame left, it waits for the next
+ * pass. Rectangles bigger than half the frame just go right behind the
+ * beam.
  *
- * The below information has been gathered using nothing but a lot of time and
- * perseverance.
+ * Sleeps, so process context only. Returns the scanline when done, or -1
+ * when it is not known, in which case the caller just goes ahead.
  */
-static __u32
-vt3122_pll_generate(int clock)
+int
+chrome_scanline_wait(struct chrome_info *info, int top, int bottom)
 {
-	__u32 pll;
-	int diff = 300000;
+	int total = info->scan_total;
+	int line, lines, past, i;
+
+	if (!info->scan_line_ps || !total)
+		return -1;
+
+	top -= CHROME_SCAN_MARGIN;
+	bottom += CHROME_SCAN_MARGIN;
+	if (top < 0)
+		top = 0;
+	if (bottom > total)
+		bottom = total;
+	if (top >= bottom)
+		return chrome_scanline(info);
+	lines = bottom - top;
+
+	for (i = 0; i < 3; i++) {
+		line = chrome_scanline(info);
+		if (line < 0) {
+			if (chrome_scanline_resync(info))
+				return -1;
+			line = chrome_scanline(info);
+			if (line < 0)
+				return -1;
+		}
 
-	DBG(__func__);
+		/* lines since the beam left the bottom, if it is outside */
+		past = line - bottom;
+		if (past < 0)
+			past += total;
 
-	if (clock > 72514)
-		pll = vt3122_pll_generate_best(clock, 1, 2, 25, &diff);
-	else if (clock > 71788)
-		pll = vt3122_pll_generate_best(clock, 1, 16, 24, &diff);
-	else if (clock > 71389) {
-		pll = 0x1050; /* Big singularity. */
-
-		diff = clock - 71590;
-		if (diff < 0)
-			diff *= -1;
-	} else if (clock > 48833) {
-		__u32 tmp_pll;
-
-		pll = vt3122_pll_generate_best(clock, 2, 7, 18, &diff);
-
-		if (clock > 69024)
-			tmp_pll = vt3122_pll_generate_best(clock, 1, 15, 23, &diff);
-		else if (clock > 63500)
-			tmp_pll = vt3122_pll_generate_best(clock, 1, 15, 21, &diff);
-		else if (clock > 52008)
-			tmp_pll = vt3122_pll_generate_best(clock, 1, 17, 19, &diff);
-		else
-			tmp_pll = vt3122_pll_generate_best(clock, 1, 17, 17, &diff);
-
-		if (tmp_pll)
-			pll = tmp_pll;
-	} else if (clock > 35220)
-		pll = vt3122_pll_generate_best(clock, 2, 11, 24, &diff);
-	else if (clock > 34511)
-		pll = vt3122_pll_generate_best(clock, 2, 11, 23, &diff);
-	else if (clock > 33441)
-		pll = vt3122_pll_generate_best(clock, 2, 13, 22, &diff);
-	else if (clock > 31967)
-		pll = vt3122_pll_generate_best(clock, 2, 11, 21, &diff);
+		if ((past < (total - lines)) &&
+		    (((total - lines - past) >= lines) ||
+		     ((total - lines) < lines)))
+			return line;
+
+		/* until it leaves the bottom behind again */
+		chrome_scanline_sleep(info,
+				      chrome_scanline_ns(info, total - past));
+	}
+
+	return chrome_scanline(info);
+}
+
+/*
+ * The part of the image that depends on driver state rather than on the mode:
+ * blanking and the start address. Applied on top of a cached image as well,
+ * where it folds into the entries that are already there.
+ */
+static void
+chrome_mode_finish(struct chrome_info *info, struct fb_var_screeninfo *mode,
+                   struct chrome_mode_regs *regs)
+{
+	__u32 bytes_per_pixel, pitch, base, line;
+
+	/* stay dark: keep display fetch off */
+	if (info->blank != FB_BLANK_UNBLANK)
+		chrome_reg_sr(regs, 0x01, 0x20, 0x20);
 	else
-		pll = vt3122_pll_generate_best(clock, 4, 8, 19, &diff);
+		chrome_reg_sr(regs, 0x01, 0x00, 0x20);
 
-	printk(KERN_DEBUG "%s: pll: 0x%04X (%d off from %d)\n",
-	       __func__, pll, diff, clock);
-	return pll;
+	/* Start address, against the pitch as set in CR13 */
+	if (mode->bits_per_pixel < 24)
+		bytes_per_pixel = mode->bits_per_pixel / 8;
+	else
+		bytes_per_pixel = 4;
+	pitch = ((mode->xres_virtual * bytes_per_pixel) + 31) & ~31;
+
+	base = chrome_mode_start(mode, pitch);
+	chrome_reg_cr(regs, 0x0C, base >> 8, 0xFF);
+	chrome_reg_cr(regs, 0x0D, base, 0xFF);
+	chrome_reg_cr(regs, 0x34, base >> 16, 0xFF);
+	chrome_reg_cr(regs, 0x48, base >> 24, 0x03);
+
+	/* line compare: past it, the CRTC starts again from address 0. Our
+	 * scanlines are only the framebuffers lines without the scaler. */
+	if (info->split && (info->split < mode->yres) && !mode->rotate &&
+	    !info->scale)
+		line = mode->yres - info->split - 1;
+	else
+		line = 0x3FFF;
+	chrome_reg_cr(regs, 0x18, line, 0xFF);
+	chrome_reg_cr(regs, 0x07, line >> 4, 0x10);
+	chrome_reg_cr(regs, 0x09, line >> 3, 0x40);
+	chrome_reg_cr(regs, 0x35, line >> 6, 0x10);
+	chrome_reg_cr(regs, 0x33, line >> 10, 0x06);
 }
 
 /*
- *
+ * Phase one: build and validate the complete register image. Nothing
+ * touches the hardware here, so a failure leaves the current mode intact.
  */
-static int
-vt3108_pll_generate_best(int clock, int shift, int div, int old_diff,
-                         __u32 *pll)
+int
+chrome_mode_build(struct chrome_info *info, struct fb_var_screeninfo *mode,
+                  struct chrome_mode_regs *regs)
 {
-	int mult;
-	int diff;
+	struct fb_var_screeninfo physical, timing;
+	int ret;
+
+	ret = chrome_mode_valid(info, mode);
+	if (ret)
+		return ret;
 
-	mult = clock * (div << shift) * 1000;
-	mult /= 14318;
-	mult += 500; /* round */
-	mult /= 1000;
+	if (mode->rotate) {
+		chrome_mode_physical(mode, &physical);
+		mode = &physical;
+	}
 
-	if (mult > 257) /* Don't go over 0xFF + 2; wobbly */
-		return old_diff;
+	regs->count = 0;
+
+	if (info->scale) {
+		/* output timing, with the framebuffer layout */
+		timing = info->mode_output;
+		timing.bits_per_pixel = mode->bits_per_pixel;
+		timing.xres_virtual = mode->xres_virtual;
+		timing.yres_virtual = mode->yres_virtual;
+
+		chrome_mode_crtc_primary(regs, &timing);
+		chrome_mode_fetch(regs, mode);
+		info->chip->fifo(regs, &timing);
+		chrome_mode_scaler(info, regs, mode, &timing);
+	} else {
+		chrome_mode_crtc_primary(regs, mode);
+		info->chip->fifo(regs, mode);
+	}
 
-	diff = clock - mult * 14318 / (div << shift);
-	if (diff < 0)
-		diff *= -1;
+	chrome_mode_finish(info, mode, regs);
 
-	if (diff < old_diff) {
-		*pll = (mult - 2) << 16;
-		*pll |= div - 2;
-		*pll |= shift << 10;
-		return diff;
-	} else
-		return old_diff;
+	/* handle outputs here */
+
+	if (regs->count > CHROME_MODE_REGS_MAX) {
+		printk(KERN_ERR "%s: register image overflow (%d).\n",
+		       __func__, regs->count);
+		return -ENOSPC;
+	}
+
+	regs->pll = chrome_pll_generate(info, PICOS2KHZ(mode->pixclock));
+	if (!regs->pll) {
+		printk(KERN_WARNING "%s: no PLL setting for %ldkHz.\n",
+		       __func__, PICOS2KHZ(mode->pixclock));
+		return -EINVAL;
+	}
+
+	return 0;
 }
 
 /*
- *
+ * Phase two: blast the image out in one go, at the start of vertical
+ * retrace, with interrupts off so that we are not torn apart halfway, and
+ * with the LUT worker kept off the AR.
  */
-static __u32
-vt3108_pll_generate(int clock)
+void
+chrome_mode_commit(struct chrome_info *info, struct chrome_mode_regs *regs)
 {
-	__u32 pll;
-	int diff = 300000;
+	unsigned long flags;
+	u64 start, wait, end;
 	int i;
 
-	DBG(__func__);
+	start = chrome_time_ns();
 
-	for (i = 2; i < 15; i++)
-		diff = vt3108_pll_generate_best(clock, 0, i, diff, &pll);
+	if (chrome_vblank_wait(info))
+		printk(KERN_DEBUG "%s: no retrace seen.\n", __func__);
 
-	for (i = 2; i < 15; i++)
-		diff = vt3108_pll_generate_best(clock, 1, i, diff, &pll);
+	wait = chrome_time_ns();
 
-	for (i = 2; i < 32; i++)
-		diff = vt3108_pll_generate_best(clock, 2, i, diff, &pll);
+	spin_lock_irqsave(&info->vga_lock, flags);
 
-	for (i = 2; i < 21; i++)
-		diff = vt3108_pll_generate_best(clock, 3, i, diff, &pll);
+	/* syncs off, and hold the sequencer in reset. Not part of the image:
+	 * it folds writes to the same register into one. */
+	chrome_vga_cr_mask(info, 0x17, 0x00, 0x80);
+	chrome_vga_seq_write(info, 0x00, 0x00);
 
-	printk(KERN_DEBUG "%s: PLL: 0x%04X (%d off from %d)\n",
-	       __func__, pll, diff, clock);
+	for (i = 0; i < regs->count; i++)
+		chrome_mode_reg_write(info, &regs->regs[i]);
 
-	return pll;
+	chrome_pll_primary_set(info, regs->pll);
+
+	chrome_vga_seq_write(info, 0x00, 0x03);
+	chrome_vga_cr_mask(info, 0x17, 0x80, 0x80);
+
+	spin_unlock_irqrestore(&info->vga_lock, flags);
+
+	end = chrome_time_ns();
+
+	/* the CRTC restarted, the next retrace seen sets the stamp */
+	chrome_scanline_timing(info, regs);
+
+	info->mode_vblank_wait_ns = wait - start;
+	info->mode_commit_ns = end - start;
+	if (info->mode_commit_ns > info->mode_commit_max_ns)
+		info->mode_commit_max_ns = info->mode_commit_ns;
 }
 
 /*
- *
+ * The complete image for mode: replayed from the list, or built from
+ * scratch.
  */
-__u32
-chrome_pll_generate(struct chrome_info *info, int clock)
+int
+chrome_mode_prepare(struct chrome_info *info, struct fb_var_screeninfo *mode,
+                    struct chrome_mode_regs *regs)
 {
-	DBG(__func__);
-
-	switch (info->id) {
-	case PCI_CHIP_VT3122:
-	case PCI_CHIP_VT7205:
-		return vt3122_pll_generate(clock);
-	case PCI_CHIP_VT3108:
-		return vt3108_pll_generate(clock);
-	default:
-		printk(KERN_WARNING "%s: Unhandled Chipset: 0x%04X\n",
-		       __func__, info->id);
+	struct fb_var_screeninfo physical;
+	struct chrome_mode_image *image;
+	int ret;
+
+	/* a mode from the list: replay its image */
+	image = chrome_mode_image_find(info, mode);
+	if (image) {
+		*regs = image->regs;
+		if (mode->rotate) {
+			chrome_mode_physical(mode, &physical);
+			chrome_mode_finish(info, &physical, regs);
+		} else
+			chrome_mode_finish(info, mode, regs);
+		info->mode_image_hits++;
 		return 0;
 	}
-}
 
+	ret = chrome_mode_build(info, mode, regs);
+	if (!ret)
+		chrome_mode_image_add(info, mode, mode, regs);
+	info->mode_image_misses++;
+
+	return ret;
+}
 
 /*
  * Primary only, so far.
@@ -646,22 +1146,396 @@ chrome_pll_generate(struct chrome_info *info, int clock)
 int
 chrome_mode_write(struct chrome_info *info, struct fb_var_screeninfo *mode)
 {
-	__u32 pll;
+	struct chrome_mode_regs *regs;
+	int ret;
 
         DBG(__func__);
 
-        printk("Setting up %dx%d:%dps\n", mode->xres, mode->yres, mode->pixclock);
+	CHROME_DEBUG("Setting up %dx%d:%dps\n", mode->xres, mode->yres,
+		     mode->pixclock);
 
-	chrome_vga_cr_mask(info, 0x17, 0x00, 0x80);
+	/* too big for the stack */
+	regs = kmalloc(sizeof(struct chrome_mode_regs), GFP_KERNEL);
+	if (!regs)
+		return -ENOMEM;
 
-	chrome_mode_crtc_primary(info, mode);
+	ret = chrome_mode_prepare(info, mode, regs);
+	if (!ret)
+		chrome_mode_commit(info, regs);
 
-	/* handle outputs here */
+	kfree(regs);
 
-	pll = chrome_pll_generate(info, PICOS2KHZ(mode->pixclock));
-	chrome_pll_primary_set(info, pll);
+	return ret;
+}
 
-	chrome_vga_cr_mask(info, 0x17, 0x80, 0x80);
+/*
+ * Split screen: the bottom lines show the framebuffer from offset 0, the
+ * top keeps following the start address. 0 turns it off. Goes through
+ * the register image, so only the line compare registers get written,
+ * in vertical blank.
+ */
+int
+chrome_mode_split(struct chrome_info *info, __u32 lines)
+{
+	struct fb_var_screeninfo *mode = &info->fb_info.var;
+	struct chrome_mode_regs *regs;
+	__u32 old;
+	int ret = 0;
+
+	acquire_console_sem();
+
+	if (lines && ((lines >= mode->yres) || mode->rotate || info->scale)) {
+		ret = -EINVAL;
+		goto out;
+	}
+
+	if (lines == info->split)
+		goto out;
+
+	/* too big for the stack */
+	regs = kmalloc(2 * sizeof(struct chrome_mode_regs), GFP_KERNEL);
+	if (!regs) {
+		ret = -ENOMEM;
+		goto out;
+	}
+
+	old = info->split;
+	info->split = lines;
+
+	ret = chrome_mode_prepare(info, mode, &regs[0]);
+	if (ret)
+		info->split = old;
+	else {
+		chrome_mode_regs_read(info, &regs[0], &regs[1]);
+		chrome_mode_replay(info, &regs[0], &regs[1]);
+	}
+
+	kfree(regs);
+ out:
+	release_console_sem();
+	return ret;
+}
+
+/*
+ * Read back the registers that regs programs, as full bytes.
+ */
+void
+chrome_mode_regs_read(struct chrome_info *info, struct chrome_mode_regs *regs,
+                      struct chrome_mode_regs *current_regs)
+{
+	struct chrome_reg *reg;
+	int i;
+
+	current_regs->count = regs->count;
+
+	spin_lock(&info->vga_lock);
+
+	for (i = 0; i < regs->count; i++) {
+		reg = &current_regs->regs[i];
+		*reg = regs->regs[i];
+		reg->mask = 0xFF;
+
+		switch (reg->bank) {
+		case CHROME_REG_MISC:
+			reg->value = chrome_vga_misc_read(info);
+			break;
+		case CHROME_REG_SR:
+			reg->value = chrome_vga_seq_read(info, reg->index);
+			break;
+		case CHROME_REG_CR:
+			reg->value = chrome_vga_cr_read(info, reg->index);
+			break;
+		case CHROME_REG_GR:
+			reg->value = chrome_vga_graph_read(info, reg->index);
+			break;
+		case CHROME_REG_AR:
+			reg->value = chrome_vga_attr_read(info, reg->index);
+			break;
+		default:
+			break;
+		}
+	}
+
+	spin_unlock(&info->vga_lock);
+
+	current_regs->pll = info->chip->pll_get(info);
+}
+
+/*
+ * Bring the hardware from current_regs, as read back, to regs, writing only
+ * the registers that differ. A different dotclock needs the full commit,
+ * everything else is written during retrace without a sequencer reset.
+ *
+ * Returns the number of registers written.
+ */
+int
+chrome_mode_replay(struct chrome_info *info, struct chrome_mode_regs *regs,
+                   struct chrome_mode_regs *current_regs)
+{
+	struct chrome_reg reg, *old;
+	unsigned long flags;
+	int i, count = 0;
+
+	if (current_regs->pll != regs->pll) {
+		chrome_mode_commit(info, regs);
+		return regs->count;
+	}
+
+	chrome_vblank_wait(info);
+
+	spin_lock_irqsave(&info->vga_lock, flags);
+
+	for (i = 0; i < regs->count; i++) {
+		reg = regs->regs[i];
+		old = &current_regs->regs[i];
+
+		if (!((old->value ^ reg.value) & reg.mask))
+			continue;
+
+		reg.value = (old->value & ~reg.mask) | (reg.value & reg.mask);
+		reg.mask = 0xFF;
+		chrome_mode_reg_write(info, &reg);
+		count++;
+	}
+
+	spin_unlock_irqrestore(&info->vga_lock, flags);
+
+	if (count)
+		chrome_scanline_timing(info, regs);
+
+	return count;
+}
+
+/*
+ *
+ */
+void
+chrome_mode_init(struct chrome_info *info)
+{
+	chrome_debugfs_u32(info, "mode_commit_ns", &info->mode_commit_ns);
+	chrome_debugfs_u32(info, "mode_commit_max_ns",
+			   &info->mode_commit_max_ns);
+	chrome_debugfs_u32(info, "mode_vblank_wait_ns",
+			   &info->mode_vblank_wait_ns);
+	chrome_debugfs_u32(info, "blank", &info->blank);
+	chrome_debugfs_u32(info, "mode_image_hits", &info->mode_image_hits);
+	chrome_debugfs_u32(info, "mode_image_misses", &info->mode_image_misses);
+}
+
+/*
+ * output= option, before the modelist gets built. The timing has to be
+ * valid on its own; without the option or when it is not, there is no
+ * scaling.
+ */
+void
+chrome_scaler_init(struct chrome_info *info, const char *option)
+{
+	struct fb_var_screeninfo *timing = &info->mode_output;
+
+	info->scale = 0;
+	if (!option)
+		return;
+
+	memset(timing, 0, sizeof(struct fb_var_screeninfo));
+	if (!fb_find_mode(timing, &info->fb_info, option, NULL, 0, NULL, 8) ||
+	    chrome_mode_valid(info, timing)) {
+		printk(KERN_WARNING "%s: output \"%s\" is not valid here.\n",
+		       __func__, option);
+		return;
+	}
+
+	timing->xres_virtual = timing->xres;
+	timing->yres_virtual = timing->yres;
+	timing->xoffset = 0;
+	timing->yoffset = 0;
+	info->scale = 1;
+
+	printk(KERN_INFO "chromefb: output fixed at %dx%d, %dkHz dotclock.\n",
+	       timing->xres, timing->yres, (int) PICOS2KHZ(timing->pixclock));
+}
+
+/*
+ * Do both modes result in the same CRTC programming?
+ */
+int
+chrome_mode_equal(struct fb_var_screeninfo *a, struct fb_var_screeninfo *b)
+{
+	return (a->xres == b->xres) && (a->yres == b->yres) &&
+		(a->xres_virtual == b->xres_virtual) &&
+		(a->bits_per_pixel == b->bits_per_pixel) &&
+		(a->pixclock == b->pixclock) &&
+		(a->left_margin == b->left_margin) &&
+		(a->right_margin == b->right_margin) &&
+		(a->upper_margin == b->upper_margin) &&
+		(a->lower_margin == b->lower_margin) &&
+		(a->hsync_len == b->hsync_len) &&
+		(a->vsync_len == b->vsync_len) &&
+		(a->rotate == b->rotate) &&
+		((a->sync ^ b->sync) &
+		 (FB_SYNC_HOR_HIGH_ACT | FB_SYNC_VERT_HIGH_ACT)) == 0;
+}
+
+/*
+ * Read back what the firmware left on the primary CRTC: the inverse of
+ * chrome_mode_crtc_primary() and chrome_pan_display().
+ *
+ * Only modes we could have set ourselves are handed back; textmode and
+ * anything with character cells or doublescan is refused.
+ */
+int
+chrome_mode_read(struct chrome_info *info, struct fb_var_screeninfo *mode)
+{
+	__u32 htotal, hdisplay, hsync_start, hsync_end;
+	__u32 vtotal, vdisplay, vsync_start, vsync_end;
+	__u32 bytes_per_pixel, pitch, offset;
+	unsigned char cr07, cr09, cr33, cr35, misc, tmp;
+	int clock;
+
+	DBG(__func__);
+
+	/* Are we in graphics mode at all? */
+	if (!(chrome_vga_attr_read(info, 0x10) & 0x01))
+		return -EINVAL;
+
+	/* extended mode, and a bpp that we know of */
+	tmp = chrome_vga_seq_read(info, 0x15);
+	if (!(tmp & 0x02))
+		return -EINVAL;
+
+	memset(mode, 0, sizeof(struct fb_var_screeninfo));
+
+	switch (tmp & 0x1C) {
+	case 0x00:
+		mode->bits_per_pixel = 8;
+		bytes_per_pixel = 1;
+		break;
+	case 0x14:
+		mode->bits_per_pixel = 16;
+		bytes_per_pixel = 2;
+		break;
+	case 0x0C:
+		mode->bits_per_pixel = 32;
+		bytes_per_pixel = 4;
+		break;
+	default:
+		return -EINVAL;
+	}
+
+	cr07 = chrome_vga_cr_read(info, 0x07);
+	cr09 = chrome_vga_cr_read(info, 0x09);
+	cr33 = chrome_vga_cr_read(info, 0x33);
+	cr35 = chrome_vga_cr_read(info, 0x35);
+
+	/* doublescan or character rows: not ours. */
+	if (cr09 & 0x9F)
+		return -EINVAL;
+
+	/* Horizontal */
+	htotal = chrome_vga_cr_read(info, 0x00);
+	htotal |= (chrome_vga_cr_read(info, 0x36) & 0x08) << 5;
+	htotal = (htotal + 5) << 3;
+
+	hdisplay = (chrome_vga_cr_read(info, 0x01) + 1) << 3;
+
+	hsync_start = chrome_vga_cr_read(info, 0x04);
+	hsync_start |= (cr33 & 0x10) << 4;
+
+	/* only the lower 5 bits of sync end are stored */
+	hsync_end = (hsync_start & ~0x1F) |
+		(chrome_vga_cr_read(info, 0x05) & 0x1F);
+	if (hsync_end <= hsync_start)
+		hsync_end += 0x20;
+
+	hsync_start <<= 3;
+	hsync_end <<= 3;
+
+	/* Vertical */
+	vtotal = chrome_vga_cr_read(info, 0x06);
+	vtotal |= (cr07 & 0x01) << 8;
+	vtotal |= (cr07 & 0x20) << 4;
+	vtotal |= (cr35 & 0x01) << 10;
+	vtotal += 2;
+
+	vdisplay = chrome_vga_cr_read(info, 0x12);
+	vdisplay |= (cr07 & 0x02) << 7;
+	vdisplay |= (cr07 & 0x40) << 3;
+	vdisplay |= (cr35 & 0x04) << 8;
+	vdisplay += 1;
+
+	vsync_start = chrome_vga_cr_read(info, 0x10);
+	vsync_start |= (cr07 & 0x04) << 6;
+	vsync_start |= (cr07 & 0x80) << 2;
+	vsync_start |= (cr35 & 0x02) << 9;
+
+	/* and only the lower 4 bits here */
+	vsync_end = (vsync_start & ~0x0F) |
+		(chrome_vga_cr_read(info, 0x11) & 0x0F);
+	if (vsync_end <= vsync_start)
+		vsync_end += 0x10;
+
+	if ((hsync_start < hdisplay) || (hsync_end > htotal) ||
+	    (vsync_start < vdisplay) || (vsync_end > vtotal))
+		return -EINVAL;
+
+	mode->xres = hdisplay;
+	mode->right_margin = hsync_start - hdisplay;
+	mode->hsync_len = hsync_end - hsync_start;
+	mode->left_margin = htotal - hsync_end;
+
+	mode->yres = vdisplay;
+	mode->lower_margin = vsync_start - vdisplay;
+	mode->vsync_len = vsync_end - vsync_start;
+	mode->upper_margin = vtotal - vsync_end;
+
+	/* Offset, in units of 8 bytes */
+	pitch = chrome_vga_cr_read(info, 0x13);
+	pitch |= (cr35 & 0xE0) << 3;
+	pitch <<= 3;
+	if (pitch < (hdisplay * bytes_per_pixel))
+		return -EINVAL;
+
+	mode->xres_virtual = pitch / bytes_per_pixel;
+
+	/* Start address, in units of 2 bytes */
+	offset = chrome_vga_cr_read(info, 0x0D);
+	offset |= chrome_vga_cr_read(info, 0x0C) << 8;
+	offset |= chrome_vga_cr_read(info, 0x34) << 16;
+	offset |= (chrome_vga_cr_read(info, 0x48) & 0x03) << 24;
+	offset <<= 1;
+
+	mode->yoffset = offset / pitch;
+	mode->xoffset = (offset % pitch) / bytes_per_pixel;
+	mode->yres_virtual = mode->yoffset + vdisplay;
+
+	/* Clock */
+	misc = chrome_vga_misc_read(info);
+	switch ((misc >> 2) & 0x03) {
+	case 0x00:
+		clock = 25175;
+		break;
+	case 0x01:
+		clock = 28322;
+		break;
+	default:
+		clock = chrome_pll_primary_get(info);
+		break;
+	}
+	if (!clock)
+		return -EINVAL;
+	mode->pixclock = KHZ2PICOS(clock);
+
+	if (!(misc & 0x40))
+		mode->sync |= FB_SYNC_HOR_HIGH_ACT;
+	if (!(misc & 0x80))
+		mode->sync |= FB_SYNC_VERT_HIGH_ACT;
+
+	mode->vmode = FB_VMODE_NONINTERLACED;
+	mode->activate = FB_ACTIVATE_NOW;
+	mode->height = -1;
+	mode->width = -1;
+
+	CHROME_DEBUG("%s: %dx%d@%dbpp, %dkHz, pitch %d\n", __func__,
+		     mode->xres, mode->yres, mode->bits_per_pixel, clock, pitch);
 
 	return 0;
 }
@@ -0,0 +1,300 @@
+/*
+ * chromefb: driver for VIAs UniChrome and Chrome IGP graphics.
+ *
+ * Copyright (c) 2007 by Luc Verhaegen (libv@skynet.be)
+ *
+ * This file is subject to the terms and conditions of the GNU General
+ * Public License.  See the file COPYING in the main directory of this
+ * archive for more details.
+ *
+ */
+/*
+ * Modelist and register images.
+ *
+ * At probe, the VESA modes and the mode= option only go through the cheap
+ * checks, size and dotclock range, and what passes goes into
+ * fb_info.modelist. The deferred part of probe then validates them at each
+ * depth and builds them into a register image, PLL word included. check_var
+ * then only needs a lookup for these, and set_par replays the image
+ * instead of building it again. Modes that are set later on are added as
+ * long as there is room.
+ *
+ * Images are built unblanked with no panning: chrome_mode_write() applies
+ * the blank and start address on top of the replayed image.
+ */
+
+#include <linux/kernel.h>
+#include <linux/fb.h>
+#include <linux/slab.h>
+#include <linux/vmalloc.h>
+#include <linux/string.h>
+
+#include "chrome.h"
+#include "chrome_pll.h"
+
+/*
+ * Same CRTC programming. Whether there is enough panning room is up to
+ * the caller.
+ */
+struct chrome_mode_image *
+chrome_mode_image_find(struct chrome_info *info, struct fb_var_screeninfo *mode)
+{
+	struct chrome_mode_image *image;
+	int i;
+
+	for (i = 0; i < info->mode_image_count; i++) {
+		image = &info->mode_images[i];
+
+		if (chrome_mode_equal(mode, &image->mode) ||
+		    chrome_mode_equal(mode, &image->request))
+			return image;
+	}
+
+	return NULL;
+}
+
+/*
+ * regs is copied, so it can be the one that is about to be committed.
+ */
+void
+chrome_mode_image_add(struct chrome_info *info,
+		      struct fb_var_screeninfo *request,
+		      struct fb_var_screeninfo *mode,
+		      struct chrome_mode_regs *regs)
+{
+	struct chrome_mode_image *image;
+
+	if (!info->mode_images ||
+	    (info->mode_image_count >= CHROME_MODE_IMAGES))
+		return;
+
+	image = &info->mode_images[info->mode_image_count];
+	image->request = *request;
+	image->mode = *mode;
+	image->regs = *regs;
+
+	/* check_var does not wait for the init worker, which adds these */
+	smp_wmb();
+	info->mode_image_count++;
+}
+
+/*
+ * check_var: a mode from the list gets the values that chrome_mode_valid()
+ * would have handed back, without running it. Everything else goes the
+ * long way. Hits and misses are counted when the image is used, in
+ * chrome_mode_prepare().
+ */
+int
+chrome_mode_image_valid(struct chrome_info *info,
+			struct fb_var_screeninfo *mode)
+{
+	struct chrome_mode_image *image;
+	int ret;
+
+	image = chrome_mode_image_find(info, mode);
+	if (!image || (mode->yres_virtual > image->mode.yres_virtual)) {
+		ret = chrome_mode_valid(info, mode);
+
+		/* so that the next lookup for this much panning hits */
+		if (!ret && image &&
+		    (mode->yres_virtual > image->mode.yres_virtual))
+			image->mode.yres_virtual = mode->yres_virtual;
+		return ret;
+	}
+
+	mode->xres = image->mode.xres;
+	mode->yres = image->mode.yres;
+	mode->xres_virtual = image->mode.xres_virtual;
+	if (mode->rotate)
+		mode->yres_virtual = image->mode.yres_virtual;
+	mode->pixclock = image->mode.pixclock;
+	mode->left_margin = image->mode.left_margin;
+	mode->right_margin = image->mode.right_margin;
+	mode->upper_margin = image->mode.upper_margin;
+	mode->lower_margin = image->mode.lower_margin;
+	mode->hsync_len = image->mode.hsync_len;
+	mode->vsync_len = image->mode.vsync_len;
+	mode->sync = image->mode.sync;
+
+	/* the image might have a larger yres than was asked for */
+	if (mode->yres_virtual < mode->yres)
+		mode->yres_virtual = mode->yres;
+
+	if (((mode->xoffset + mode->xres) > mode->xres_virtual) ||
+	    ((mode->yoffset + mode->yres) > mode->yres_virtual)) {
+		printk(KERN_WARNING "Offset %dx%d lies outside of the virtual "
+		       "resolution.\n", mode->xoffset, mode->yoffset);
+		return -EINVAL;
+	}
+
+	return 0;
+}
+
+/*
+ * The cheap checks, so that the usual suspects neither fill the log nor
+ * cost a PLL solve.
+ */
+static int
+chrome_modelist_fits(struct chrome_info *info, struct fb_var_screeninfo *mode)
+{
+	__u32 bytes_per_pixel, clock;
+
+	if (mode->bits_per_pixel < 24)
+		bytes_per_pixel = mode->bits_per_pixel / 8;
+	else
+		bytes_per_pixel = 4;
+
+	if ((mode->xres * mode->yres * bytes_per_pixel) >= (info->fbsize * 1024))
+		return -EINVAL;
+
+	clock = PICOS2KHZ(mode->pixclock);
+	if ((clock < CHROME_PLL_CLOCK_MIN) || (clock > CHROME_PLL_CLOCK_MAX))
+		return -EINVAL;
+
+	/* the scaler only stretches */
+	if (info->scale && ((mode->xres > info->mode_output.xres) ||
+			    (mode->yres > info->mode_output.yres)))
+		return -EINVAL;
+
+	return 0;
+}
+
+/*
+ * Validate and build one mode at one depth.
+ */
+static int
+chrome_modelist_try(struct chrome_info *info, struct fb_var_screeninfo *var,
+		    struct chrome_mode_regs *regs)
+{
+	struct fb_var_screeninfo mode = *var;
+
+	mode.xres_virtual = mode.xres;
+	mode.yres_virtual = mode.yres;
+	mode.xoffset = 0;
+	mode.yoffset = 0;
+	mode.rotate = 0;
+
+	if (chrome_modelist_fits(info, &mode))
+		return -EINVAL;
+
+	if (chrome_mode_image_find(info, &mode))
+		return 0;
+
+	if (chrome_mode_build(info, &mode, regs))
+		return -EINVAL;
+
+	var->xres_virtual = var->xres;
+	var->yres_virtual = var->yres;
+	chrome_mode_image_add(info, var, &mode, regs);
+	return 0;
+}
+
+/*
+ * Add a mode to the list when it fits at any depth, or with regs, build it
+ * at all depths that it is valid at.
+ */
+static int
+chrome_modelist_add(struct chrome_info *info,
+		    const struct fb_videomode *videomode,
+		    struct chrome_mode_regs *regs)
+{
+	static const int depths[] = { 8, 16, 32 };
+	struct fb_var_screeninfo var;
+	int i, valid = 0;
+
+	for (i = 0; i < ARRAY_SIZE(depths); i++) {
+		memset(&var, 0, sizeof(struct fb_var_screeninfo));
+		fb_videomode_to_var(&var, videomode);
+		var.bits_per_pixel = depths[i];
+
+		if (regs) {
+			if (!chrome_modelist_try(info, &var, regs))
+				valid++;
+		} else if (!chrome_modelist_fits(info, &var))
+			valid++;
+	}
+
+	if (valid && !regs)
+		fb_add_videomode(videomode, &info->fb_info.modelist);
+
+	return valid;
+}
+
+/*
+ * Before register_framebuffer(), which adds the initial mode to the list.
+ */
+void
+chrome_modelist_init(struct chrome_info *info, const char *mode_option)
+{
+	struct fb_var_screeninfo var;
+	struct fb_videomode videomode;
+	int i;
+
+	INIT_LIST_HEAD(&info->fb_info.modelist);
+
+	info->mode_image_count = 0;
+	info->mode_images = vmalloc(CHROME_MODE_IMAGES *
+				    sizeof(struct chrome_mode_image));
+	if (!info->mode_images)
+		printk(KERN_WARNING "%s: no memory for register images.\n",
+		       __func__);
+
+	/* the user asked for this one, so it goes first */
+	if (mode_option &&
+	    fb_find_mode(&var, &info->fb_info, mode_option, NULL, 0, NULL, 8)) {
+		fb_var_to_videomode(&videomode, &var);
+		chrome_modelist_add(info, &videomode, NULL);
+	}
+
+	for (i = 0; i < VESA_MODEDB_SIZE; i++)
+		chrome_modelist_add(info, &vesa_modes[i], NULL);
+}
+
+/*
+ * From the init worker: validate and build what chrome_modelist_init()
+ * put on the list, in the same order. Modes that turn out not to be valid
+ * at all stay on the list, check_var refuses them.
+ */
+void
+chrome_modelist_build(struct chrome_info *info, const char *mode_option)
+{
+	struct fb_var_screeninfo var;
+	struct fb_videomode videomode;
+	struct chrome_mode_regs *regs;
+	int i;
+
+	if (!info->mode_images)
+		return;
+
+	/* too big for the stack */
+	regs = kmalloc(sizeof(struct chrome_mode_regs), GFP_KERNEL);
+	if (!regs)
+		return;
+
+	if (mode_option &&
+	    fb_find_mode(&var, &info->fb_info, mode_option, NULL, 0, NULL, 8)) {
+		fb_var_to_videomode(&videomode, &var);
+		if (!chrome_modelist_add(info, &videomode, regs))
+			printk(KERN_WARNING "%s: mode \"%s\" is not valid here.\n",
+			       __func__, mode_option);
+	}
+
+	for (i = 0; i < VESA_MODEDB_SIZE; i++)
+		chrome_modelist_add(info, &vesa_modes[i], regs);
+
+	kfree(regs);
+}
+
+/*
+ * unregister_framebuffer() takes care of the modelist itself.
+ */
+void
+chrome_modelist_exit(struct chrome_info *info)
+{
+	info->mode_image_count = 0;
+
+	if (info->mode_images) {
+		vfree(info->mode_images);
+		info->mode_images = NULL;
+	}
+}
@@ -0,0 +1,206 @@
+/*
+ * chromefb: driver for VIAs UniChrome and Chrome IGP graphics.
+ *
+ * Copyright (c) 2006-2007 by Luc Verhaegen (libv@skynet.be)
+ *
+ * This file is subject to the terms and conditions of the GNU General
+ * Public License.  See the file COPYING in the main directory of this
+ * archive for more details.
+ *
+ */
+/*
+ * PLL solvers.
+ *
+ * No kernel dependencies in here: tools/pllbench builds this file as is.
+ */
+
+#include "chrome_pll.h"
+
+/*
+ *
+ */
+static __u32
+vt3122_pll_generate_best(int clock, int shift, int min_div, int max_div,
+                         int *best_diff)
+{
+	__u32 pll = 0;
+	__u8 pll_shift;
+	int div, mult, diff;
+
+	switch (shift) {
+	case 4:
+		pll_shift = 0x80;
+		break;
+	case 2:
+		pll_shift = 0x40;
+		break;
+	default:
+		pll_shift = 0x00;
+		break;
+	}
+
+	for (div = min_div; div <= max_div; div++) {
+		/* rounded; clock * div * shift * 1000 used to overflow */
+		mult = (clock * div * shift + CHROME_PLL_REFERENCE / 2) /
+			CHROME_PLL_REFERENCE;
+
+		if (mult < 129) {
+			diff = clock - mult * CHROME_PLL_REFERENCE / div / shift;
+
+			if (diff < 0)
+				diff *= -1;
+
+			if (diff < *best_diff) {
+				*best_diff = diff;
+				pll = ((pll_shift | div) << 8) | mult;
+			}
+		}
+	}
+
+	return pll;
+}
+
+/*
+ * This might seem nasty and ugly, but it's the best solution given the crappy
+ * limitations the VT3122 pll has.
+ *
+ * The below information has been gathered using nothing but a lot of time and
+ * perseverance.
+ */
+__u32
+vt3122_pll_generate(int clock, int *diff)
+{
+	__u32 pll;
+
+	*diff = 300000;
+
+	if (clock > 72514)
+		pll = vt3122_pll_generate_best(clock, 1, 2, 25, diff);
+	else if (clock > 71788)
+		pll = vt3122_pll_generate_best(clock, 1, 16, 24, diff);
+	else if (clock > 71389) {
+		pll = 0x1050; /* Big singularity. */
+
+		*diff = clock - 71590;
+		if (*diff < 0)
+			*diff *= -1;
+	} else if (clock > 48833) {
+		__u32 tmp_pll;
+
+		pll = vt3122_pll_generate_best(clock, 2, 7, 18, diff);
+
+		if (clock > 69024)
+			tmp_pll = vt3122_pll_generate_best(clock, 1, 15, 23, diff);
+		else if (clock > 63500)
+			tmp_pll = vt3122_pll_generate_best(clock, 1, 15, 21, diff);
+		else if (clock > 52008)
+			tmp_pll = vt3122_pll_generate_best(clock, 1, 17, 19, diff);
+		else
+			tmp_pll = vt3122_pll_generate_best(clock, 1, 17, 17, diff);
+
+		if (tmp_pll)
+			pll = tmp_pll;
+	} else if (clock > 35220)
+		pll = vt3122_pll_generate_best(clock, 2, 11, 24, diff);
+	else if (clock > 34511)
+		pll = vt3122_pll_generate_best(clock, 2, 11, 23, diff);
+	else if (clock > 33441)
+		pll = vt3122_pll_generate_best(clock, 2, 13, 22, diff);
+	else if (clock > 31967)
+		pll = vt3122_pll_generate_best(clock, 2, 11, 21, diff);
+	else
+		pll = vt3122_pll_generate_best(clock, 4, 8, 19, diff);
+
+	return pll;
+}
+
+/*
+ * Dotclock in kHz for a VT3122 SR46/SR47 pair.
+ */
+int
+vt3122_pll_clock(__u32 pll)
+{
+	int mult = pll & 0xFF;
+	int div = (pll >> 8) & 0x3F;
+	int shift;
+
+	if (pll & 0x8000)
+		shift = 4;
+	else if (pll & 0x4000)
+		shift = 2;
+	else
+		shift = 1;
+
+	if (!div)
+		return 0;
+	return mult * CHROME_PLL_REFERENCE / div / shift;
+}
+
+/*
+ *
+ */
+static int
+vt3108_pll_generate_best(int clock, int shift, int div, int old_diff,
+                         __u32 *pll)
+{
+	int mult;
+	int diff;
+
+	/* rounded; clock * (div << shift) * 1000 used to overflow */
+	mult = (clock * (div << shift) + CHROME_PLL_REFERENCE / 2) /
+		CHROME_PLL_REFERENCE;
+
+	if (mult > 257) /* Don't go over 0xFF + 2; wobbly */
+		return old_diff;
+
+	diff = clock - mult * CHROME_PLL_REFERENCE / (div << shift);
+	if (diff < 0)
+		diff *= -1;
+
+	if (diff < old_diff) {
+		*pll = (mult - 2) << 16;
+		*pll |= div - 2;
+		*pll |= shift << 10;
+		return diff;
+	} else
+		return old_diff;
+}
+
+/*
+ *
+ */
+__u32
+vt3108_pll_generate(int clock, int *diff)
+{
+	__u32 pll = 0;
+	int i;
+
+	*diff = 300000;
+
+	for (i = 2; i < 15; i++)
+		*diff = vt3108_pll_generate_best(clock, 0, i, *diff, &pll);
+
+	for (i = 2; i < 15; i++)
+		*diff = vt3108_pll_generate_best(clock, 1, i, *diff, &pll);
+
+	for (i = 2; i < 32; i++)
+		*diff = vt3108_pll_generate_best(clock, 2, i, *diff, &pll);
+
+	for (i = 2; i < 21; i++)
+		*diff = vt3108_pll_generate_best(clock, 3, i, *diff, &pll);
+
+	return pll;
+}
+
+/*
+ * Dotclock in kHz for a VT3108 SR44/SR45/SR46 triplet.
+ */
+int
+vt3108_pll_clock(__u32 pll)
+{
+	int mult = ((pll >> 16) & 0xFF) + 2;
+	int div = (pll & 0x3FF) + 2;
+	int shift = (pll >> 10) & 0x03;
+
+	return mult * CHROME_PLL_REFERENCE / (div << shift);
+}
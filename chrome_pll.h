@@ -0,0 +1,40 @@
+/*
+ * chromefb: driver for VIAs UniChrome and Chrome IGP graphics.
+ *
+ * Copyright (c) 2007 by Luc Verhaegen (libv@skynet.be)
+ *
+ * This file is subject to the terms and conditions of the GNU General
+ * Public License.  See the file COPYING in the main directory of this
+ * archive for more details.
+ *
+ */
+/*
+ * PLL solvers. These are pure functions of the requested dotclock, so that
+ * tools/pllbench can build and sweep them in userspace.
+ */
+#ifndef HAVE_CHROMEFB_PLL_H
+#define HAVE_CHROMEFB_PLL_H
+
+#include <linux/types.h> /* __u32, here as well as in userspace */
+
+/* reference crystal, in kHz */
+#define CHROME_PLL_REFERENCE 14318
+
+/* Lowest and highest dotclock we are willing to set up, in kHz. */
+#define CHROME_PLL_CLOCK_MIN 20000
+#define CHROME_PLL_CLOCK_MAX 200000
+
+/*
+ * VT3122, VT7205: SR46: shift (0x80: 4, 0x40: 2) | divisor, SR47: multiplier.
+ */
+__u32 vt3122_pll_generate(int clock, int *diff);
+int vt3122_pll_clock(__u32 pll);
+
+/*
+ * VT3108: SR44: multiplier - 2, SR45: shift << 2 | (divisor - 2) >> 8,
+ * SR46: (divisor - 2) & 0xFF.
+ */
+__u32 vt3108_pll_generate(int clock, int *diff);
+int vt3108_pll_clock(__u32 pll);
+
+#endif /* HAVE_CHROMEFB_PLL_H */
@@ -0,0 +1,430 @@
+/*
+ * chromefb: driver for VIAs UniChrome and Chrome IGP graphics.
+ *
+ * Copyright (c) 2007 by Luc Verhaegen (libv@skynet.be)
+ *
+ * This file is subject to the terms and conditions of the GNU General
+ * Public License.  See the file COPYING in the main directory of this
+ * archive for more details.
+ *
+ */
+/*
+ * Display rotation.
+ *
+ * The 2D engine cannot rotate, so a rotated framebuffer lives in a shadow
+ * in system memory, in the geometry the console and userspace see. The
+ * console draws into it upright, and only the damaged area gets rotated
+ * into the scanout, shortly afterwards, from keventd.
+ *
+ * Userspace mappings of the shadow cannot be tracked for damage, so while
+ * one exists the whole screen gets refreshed periodically.
+ *
+ * When calibration finds cpu reads from VRAM slow and no engine copies,
+ * unrotated modes get a shadow too: a copy of the whole virtual area that
+ * damage gets copied out of as is, so that panning keeps working.
+ */
+
+#include <linux/kernel.h>
+#include <linux/fb.h>
+#include <linux/mm.h>
+#include <linux/vmalloc.h>
+#include <linux/workqueue.h>
+
+#include "chrome.h"
+
+/* console damage gets batched for this long */
+#define CHROME_ROTATE_DELAY	(HZ / 50 + 1)
+/* refresh rate for mapped shadows */
+#define CHROME_ROTATE_MAPPED	(HZ / 10 + 1)
+
+/* pixels per column tile, keeps the source lines of a tile in cache */
+#define CHROME_ROTATE_TILE	64
+
+/*
+ *
+ */
+static inline int
+chrome_rotate_bytes(struct fb_var_screeninfo *mode)
+{
+	if (mode->bits_per_pixel < 24)
+		return mode->bits_per_pixel >> 3;
+	return 4;
+}
+
+/*
+ * Lines that the shadow holds: the virtual area when not rotated.
+ */
+static inline int
+chrome_rotate_lines(struct chrome_info *info)
+{
+	if (info->rotate == FB_ROTATE_UR)
+		return info->fb_info.var.yres_virtual;
+	return info->fb_info.var.yres;
+}
+
+/*
+ * Copy a w x h block of the scanout, from the shadow. Source pixels are
+ * step bytes apart along a scanout line, and row_step bytes apart from one
+ * scanout line to the next.
+ */
+static void
+chrome_rotate_blit(struct chrome_info *info, int bytes, u8 *src, int step,
+		   int row_step, int dx, int dy, int w, int h)
+{
+	u8 __iomem *dst;
+	u8 *s;
+	int tile, tile_w, i, j;
+
+	/* not rotated: whole lines */
+	if (step == bytes) {
+		for (j = 0; j < h; j++)
+			memcpy_toio((u8 __iomem *) info->fbbase +
+				    (dy + j) * info->rotate_pitch + dx * bytes,
+				    src + j * row_step, w * bytes);
+		return;
+	}
+
+	for (tile = 0; tile < w; tile += CHROME_ROTATE_TILE) {
+		tile_w = min(CHROME_ROTATE_TILE, w - tile);
+
+		for (j = 0; j < h; j++) {
+			s = src + tile * step + j * row_step;
+			dst = (u8 __iomem *) info->fbbase +
+				(dy + j) * info->rotate_pitch + (dx + tile) * bytes;
+
+			switch (bytes) {
+			case 4:
+				for (i = 0; i < tile_w; i++, s += step, dst += 4)
+					writel(*(u32 *) s, dst);
+				break;
+			case 2:
+				for (i = 0; i < tile_w; i++, s += step, dst += 2)
+					writew(*(u16 *) s, dst);
+				break;
+			default:
+				for (i = 0; i < tile_w; i++, s += step, dst++)
+					writeb(*s, dst);
+				break;
+			}
+		}
+	}
+}
+
+/*
+ * Rotate the damaged area of the shadow into the scanout.
+ */
+void
+chrome_rotate_flush(struct chrome_info *info)
+{
+	struct fb_var_screeninfo *mode = &info->fb_info.var;
+	int x1, y1, x2, y2, bytes, pitch, dx, dy, w, h, step, row_step;
+	unsigned long flags;
+	u8 *src;
+	u64 start;
+
+	if (!info->shadow)
+		return;
+
+	spin_lock_irqsave(&info->damage_lock, flags);
+	x1 = info->damage_x1;
+	y1 = info->damage_y1;
+	x2 = info->damage_x2;
+	y2 = info->damage_y2;
+	info->damage_x1 = info->damage_y1 = 0;
+	info->damage_x2 = info->damage_y2 = 0;
+	spin_unlock_irqrestore(&info->damage_lock, flags);
+
+	if ((x1 >= x2) || (y1 >= y2))
+		return;
+
+	start = chrome_time_ns();
+
+	bytes = chrome_rotate_bytes(mode);
+	pitch = info->fb_info.fix.line_length;
+
+	switch (info->rotate) {
+	case FB_ROTATE_UR:
+		dx = x1;
+		dy = y1;
+		w = x2 - x1;
+		h = y2 - y1;
+		src = info->shadow + y1 * pitch + x1 * bytes;
+		step = bytes;
+		row_step = pitch;
+		break;
+	case FB_ROTATE_CW: /* (x, y) -> (yres - 1 - y, x) */
+		dx = mode->yres - y2;
+		dy = x1;
+		w = y2 - y1;
+		h = x2 - x1;
+		src = info->shadow + (y2 - 1) * pitch + x1 * bytes;
+		step = -pitch;
+		row_step = bytes;
+		break;
+	case FB_ROTATE_CCW: /* (x, y) -> (y, xres - 1 - x) */
+		dx = y1;
+		dy = mode->xres - x2;
+		w = y2 - y1;
+		h = x2 - x1;
+		src = info->shadow + y1 * pitch + (x2 - 1) * bytes;
+		step = pitch;
+		row_step = -bytes;
+		break;
+	case FB_ROTATE_UD: /* (x, y) -> (xres - 1 - x, yres - 1 - y) */
+		dx = mode->xres - x2;
+		dy = mode->yres - y2;
+		w = x2 - x1;
+		h = y2 - y1;
+		src = info->shadow + (y2 - 1) * pitch + (x2 - 1) * bytes;
+		step = -bytes;
+		row_step = -pitch;
+		break;
+	default:
+		return;
+	}
+
+	chrome_rotate_blit(info, bytes, src, step, row_step, dx, dy, w, h);
+
+	info->rotate_flushes++;
+	info->rotate_pixels += w * h;
+	info->rotate_flush_ns = chrome_time_ns() - start;
+}
+
+/*
+ *
+ */
+static void
+chrome_rotate_worker(struct work_struct *work)
+{
+	struct chrome_info *info =
+		container_of(work, struct chrome_info, rotate_work.work);
+
+	if (atomic_read(&info->shadow_maps)) {
+		chrome_rotate_damage(info, 0, 0, info->fb_info.var.xres,
+				     chrome_rotate_lines(info));
+		chrome_rotate_flush(info);
+		schedule_delayed_work(&info->rotate_work, CHROME_ROTATE_MAPPED);
+	} else
+		chrome_rotate_flush(info);
+}
+
+/*
+ * Grow the damaged area, in shadow coordinates, and get a flush going.
+ * Called from the drawing ops, so it cannot sleep.
+ */
+void
+chrome_rotate_damage(struct chrome_info *info, int x, int y, int width,
+		     int height)
+{
+	unsigned long flags;
+	int idle;
+
+	if ((width <= 0) || (height <= 0))
+		return;
+
+	spin_lock_irqsave(&info->damage_lock, flags);
+	idle = (info->damage_x1 >= info->damage_x2);
+	if (idle) {
+		info->damage_x1 = x;
+		info->damage_y1 = y;
+		info->damage_x2 = x + width;
+		info->damage_y2 = y + height;
+	} else {
+		info->damage_x1 = min(info->damage_x1, x);
+		info->damage_y1 = min(info->damage_y1, y);
+		info->damage_x2 = max(info->damage_x2, x + width);
+		info->damage_y2 = max(info->damage_y2, y + height);
+	}
+
+	/* the shadow could be smaller than what fbcon thinks */
+	info->damage_x2 = min(info->damage_x2, (int) info->fb_info.var.xres);
+	info->damage_y2 = min(info->damage_y2, chrome_rotate_lines(info));
+	spin_unlock_irqrestore(&info->damage_lock, flags);
+
+	if (idle)
+		schedule_delayed_work(&info->rotate_work, CHROME_ROTATE_DELAY);
+}
+
+/*
+ * Called from set_par, with line_length already set up for the new mode:
+ * switch between the scanout and a freshly sized shadow.
+ */
+int
+chrome_rotate_set(struct chrome_info *info)
+{
+	struct fb_info *fb_info = &info->fb_info;
+	struct fb_var_screeninfo *mode = &fb_info->var;
+	__u32 size = 0;
+	void *shadow = info->shadow;
+
+	DBG(__func__);
+
+	if (mode->rotate)
+		size = PAGE_ALIGN(fb_info->fix.line_length * mode->yres);
+	else if (info->calib.shadow)
+		size = PAGE_ALIGN(fb_info->fix.line_length *
+				  mode->yres_virtual);
+
+	if ((size != info->shadow_size) && atomic_read(&info->shadow_maps)) {
+		printk(KERN_WARNING "%s: shadow is still mapped.\n", __func__);
+		return -EBUSY;
+	}
+
+	cancel_rearming_delayed_work(&info->rotate_work);
+
+	if (size != info->shadow_size) {
+		if (size) {
+			shadow = vmalloc(size);
+			if (!shadow && mode->rotate) {
+				printk(KERN_ERR "%s: Unable to allocate %dkB"
+				       " shadow.\n", __func__, size >> 10);
+				return -ENOMEM;
+			}
+			/* unrotated, we can do without */
+			if (!shadow)
+				size = 0;
+			else
+				memset(shadow, 0, size);
+		} else
+			shadow = NULL;
+
+		if (info->shadow)
+			vfree(info->shadow);
+		info->shadow_size = size;
+	}
+
+	info->shadow = shadow;
+	info->rotate = mode->rotate;
+	info->damage_x1 = info->damage_y1 = 0;
+	info->damage_x2 = info->damage_y2 = 0;
+
+	if (shadow) {
+		/* scanout pitch, as programmed in CR13 */
+		if ((mode->rotate == FB_ROTATE_UR) ||
+		    (mode->rotate == FB_ROTATE_UD))
+			info->rotate_pitch = fb_info->fix.line_length;
+		else
+			info->rotate_pitch =
+				((mode->yres * chrome_rotate_bytes(mode)) + 31) & ~31;
+
+		fb_info->screen_base = (char __iomem *) shadow;
+		fb_info->fix.smem_len = size;
+
+		/* Draws are cpu only, into cached memory, with the sys_*
+		 * helpers: this is not io memory. */
+		fb_info->flags &= ~(FBINFO_HWACCEL_FILLRECT |
+				    FBINFO_HWACCEL_COPYAREA);
+		fb_info->flags |= FBINFO_READS_FAST | FBINFO_VIRTFB;
+
+		/* repaint all of it, this also restarts mapped refreshes */
+		chrome_rotate_damage(info, 0, 0, mode->xres,
+				     chrome_rotate_lines(info));
+	} else {
+		fb_info->screen_base = info->fbbase;
+		fb_info->fix.smem_len = info->fbsize * 1024;
+
+		/* what calibration found */
+		fb_info->flags &= ~(FBINFO_READS_FAST | FBINFO_VIRTFB |
+				    FBINFO_HWACCEL_FILLRECT |
+				    FBINFO_HWACCEL_COPYAREA);
+		if (info->calib.reads_fast)
+			fb_info->flags |= FBINFO_READS_FAST;
+		if (info->accel && (info->calib.fill_min != ~0))
+			fb_info->flags |= FBINFO_HWACCEL_FILLRECT;
+		if (info->accel && (info->calib.copy_min != ~0))
+			fb_info->flags |= FBINFO_HWACCEL_COPYAREA;
+	}
+
+	return 0;
+}
+
+/*
+ *
+ * mmap.
+ *
+ */
+static void
+chrome_rotate_vma_open(struct vm_area_struct *vma)
+{
+	struct chrome_info *info = vma->vm_private_data;
+
+	if (atomic_inc_return(&info->shadow_maps) == 1)
+		schedule_delayed_work(&info->rotate_work, CHROME_ROTATE_DELAY);
+}
+
+static void
+chrome_rotate_vma_close(struct vm_area_struct *vma)
+{
+	struct chrome_info *info = vma->vm_private_data;
+
+	atomic_dec(&info->shadow_maps);
+}
+
+static struct vm_operations_struct chrome_rotate_vm_ops = {
+	.open = chrome_rotate_vma_open,
+	.close = chrome_rotate_vma_close,
+};
+
+/*
+ * Map the shadow, page by page, as vmalloc memory is not contiguous.
+ */
+int
+chrome_rotate_mmap(struct chrome_info *info, struct vm_area_struct *vma)
+{
+	unsigned long offset = vma->vm_pgoff << PAGE_SHIFT;
+	unsigned long size = vma->vm_end - vma->vm_start;
+	unsigned long address = vma->vm_start;
+	u8 *shadow = info->shadow;
+	int ret;
+
+	if ((offset + size) > info->shadow_size)
+		return -EINVAL;
+
+	for (; size; size -= PAGE_SIZE) {
+		ret = remap_pfn_range(vma, address,
+				      vmalloc_to_pfn(shadow + offset),
+				      PAGE_SIZE, vma->vm_page_prot);
+		if (ret)
+			return ret;
+
+		address += PAGE_SIZE;
+		offset += PAGE_SIZE;
+	}
+
+	vma->vm_flags |= VM_RESERVED;
+	vma->vm_ops = &chrome_rotate_vm_ops;
+	vma->vm_private_data = info;
+	chrome_rotate_vma_open(vma);
+
+	return 0;
+}
+
+/*
+ *
+ */
+void
+chrome_rotate_init(struct chrome_info *info)
+{
+	spin_lock_init(&info->damage_lock);
+	INIT_DELAYED_WORK(&info->rotate_work, chrome_rotate_worker);
+	atomic_set(&info->shadow_maps, 0);
+
+	chrome_debugfs_u32(info, "rotate_flushes", &info->rotate_flushes);
+	chrome_debugfs_u32(info, "rotate_pixels", &info->rotate_pixels);
+	chrome_debugfs_u32(info, "rotate_flush_ns", &info->rotate_flush_ns);
+}
+
+/*
+ *
+ */
+void
+chrome_rotate_exit(struct chrome_info *info)
+{
+	cancel_rearming_delayed_work(&info->rotate_work);
+
+	if (info->shadow) {
+		vfree(info->shadow);
+		info->shadow = NULL;
+		info->shadow_size = 0;
+	}
+}
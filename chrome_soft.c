@@ -0,0 +1,382 @@
+/*
+ * chromefb: driver for VIAs UniChrome and Chrome IGP graphics.
+ *
+ * Copyright (c) 2007 by Luc Verhaegen (libv@skynet.be)
+ *
+ * This file is subject to the terms and conditions of the GNU General
+ * Public License.  See the file COPYING in the main directory of this
+ * archive for more details.
+ *
+ */
+/*
+ * Software rendering into VRAM, for when the 2D engine is off, busy with
+ * userspace, or not worth setting up. The shadow in system memory is
+ * drawn into with the generic sys_* helpers instead.
+ *
+ * Unlike the generic cfb code, these are specialised per bpp at compile
+ * time, store 32bits at a time wherever alignment allows, and never read
+ * from the destination. Anything unusual is handed to cfb still.
+ *
+ * All of this assumes a little endian cpu, which is a given for an IGP
+ * that only comes with VIA x86 northbridges.
+ */
+
+#include <linux/kernel.h>
+#include <linux/fb.h>
+#include <linux/slab.h>
+
+#include "chrome.h"
+
+struct chrome_soft {
+	int bpp;
+	void (*fillrect)(struct fb_info *fb_info,
+			 const struct fb_fillrect *rect);
+	void (*copyarea)(struct fb_info *fb_info,
+			 const struct fb_copyarea *area);
+	void (*imageblit)(struct fb_info *fb_info,
+			  const struct fb_image *image);
+};
+
+/*
+ * Glyph expansion: bit patterns of a glyph to byte masks, leftmost pixel
+ * in the most significant bit, and at the lowest address.
+ */
+static u32 chrome_soft_expand8[16]; /* 4 pixels */
+static u32 chrome_soft_expand16[4]; /* 2 pixels */
+
+/*
+ * A colour, repeated over 32bits.
+ */
+static inline u32
+chrome_soft_pattern(u32 colour, const int bpp)
+{
+	switch (bpp) {
+	case 8:
+		colour &= 0xFF;
+		return colour | (colour << 8) | (colour << 16) | (colour << 24);
+	case 16:
+		colour &= 0xFFFF;
+		return colour | (colour << 16);
+	default:
+		return colour;
+	}
+}
+
+/*
+ *
+ * Fill.
+ *
+ */
+static inline void
+chrome_soft_fill_line(u8 __iomem *dst, u32 bytes, u32 pattern, const int bpp)
+{
+	/* single colour, so any alignment gives the same pattern */
+	if (bpp == 8) {
+		if ((unsigned long) dst & 1) {
+			writeb(pattern, dst);
+			dst++;
+			bytes--;
+		}
+		if (((unsigned long) dst & 2) && (bytes >= 2)) {
+			writew(pattern, dst);
+			dst += 2;
+			bytes -= 2;
+		}
+	} else if ((bpp == 16) && ((unsigned long) dst & 2)) {
+		writew(pattern, dst);
+		dst += 2;
+		bytes -= 2;
+	}
+
+	for (; bytes >= 16; bytes -= 16, dst += 16) {
+		writel(pattern, dst);
+		writel(pattern, dst + 4);
+		writel(pattern, dst + 8);
+		writel(pattern, dst + 12);
+	}
+	for (; bytes >= 4; bytes -= 4, dst += 4)
+		writel(pattern, dst);
+
+	if (bytes >= 2) {
+		writew(pattern, dst);
+		dst += 2;
+		bytes -= 2;
+	}
+	if (bytes)
+		writeb(pattern, dst);
+}
+
+static inline void
+chrome_soft_fillrect_bpp(struct fb_info *fb_info,
+			 const struct fb_fillrect *rect, const int bpp)
+{
+	u32 pitch = fb_info->fix.line_length;
+	u32 bytes = rect->width * (bpp >> 3);
+	u32 pattern, i;
+	u8 __iomem *dst;
+
+	if (!bytes || !rect->height)
+		return;
+
+	/* only the cursor XORs, and that needs reads anyway */
+	if (rect->rop != ROP_COPY) {
+		cfb_fillrect(fb_info, rect);
+		return;
+	}
+
+	pattern = chrome_soft_pattern(chrome_colour(fb_info, rect->color), bpp);
+	dst = (u8 __iomem *) fb_info->screen_base + rect->dy * pitch +
+		rect->dx * (bpp >> 3);
+
+	for (i = 0; i < rect->height; i++, dst += pitch)
+		chrome_soft_fill_line(dst, bytes, pattern, bpp);
+}
+
+/*
+ *
+ * Copy.
+ *
+ */
+/*
+ * One burst read of a full line into a bounce buffer, one burst write out
+ * of it. This also takes care of horizontal overlap.
+ */
+static inline void
+chrome_soft_copyarea_bpp(struct fb_info *fb_info,
+			 const struct fb_copyarea *area, const int bpp)
+{
+	struct chrome_info *info = (struct chrome_info *) fb_info;
+	u32 pitch = fb_info->fix.line_length;
+	u32 bytes = area->width * (bpp >> 3);
+	u8 __iomem *src, *dst;
+	int i, step;
+
+	if (!info->soft_line || (bytes > info->soft_line_size)) {
+		cfb_copyarea(fb_info, area);
+		return;
+	}
+
+	src = (u8 __iomem *) fb_info->screen_base + area->sy * pitch +
+		area->sx * (bpp >> 3);
+	dst = (u8 __iomem *) fb_info->screen_base + area->dy * pitch +
+		area->dx * (bpp >> 3);
+
+	/* vertical overlap: start at the bottom */
+	if (area->dy > area->sy) {
+		src += (area->height - 1) * pitch;
+		dst += (area->height - 1) * pitch;
+		step = -pitch;
+	} else
+		step = pitch;
+
+	for (i = 0; i < area->height; i++, src += step, dst += step) {
+		memcpy_fromio(info->soft_line, src, bytes);
+		memcpy_toio(dst, info->soft_line, bytes);
+	}
+}
+
+/*
+ *
+ * Glyphs.
+ *
+ */
+static inline void
+chrome_soft_imageblit_bpp(struct fb_info *fb_info,
+			  const struct fb_image *image, const int bpp)
+{
+	u32 pitch = fb_info->fix.line_length;
+	u32 src_pitch = (image->width + 7) >> 3;
+	u32 fg, bg, eor, i, j;
+	const u8 *src = (const u8 *) image->data;
+	u8 __iomem *line, *dst;
+	u8 bits;
+	int k;
+
+	/* Only monochrome, and only whole 32bit words per glyph line. */
+	if ((image->depth != 1) || (image->width & 7) ||
+	    ((bpp == 8) && (image->dx & 3)) ||
+	    ((bpp == 16) && (image->dx & 1))) {
+		cfb_imageblit(fb_info, image);
+		return;
+	}
+
+	fg = chrome_soft_pattern(chrome_colour(fb_info, image->fg_color), bpp);
+	bg = chrome_soft_pattern(chrome_colour(fb_info, image->bg_color), bpp);
+	eor = fg ^ bg;
+
+	line = (u8 __iomem *) fb_info->screen_base + image->dy * pitch +
+		image->dx * (bpp >> 3);
+
+	for (i = 0; i < image->height; i++, line += pitch, src += src_pitch) {
+		dst = line;
+
+		for (j = 0; j < src_pitch; j++) {
+			bits = src[j];
+
+			switch (bpp) {
+			case 8:
+				writel((chrome_soft_expand8[bits >> 4] & eor) ^ bg,
+				       dst);
+				writel((chrome_soft_expand8[bits & 0x0F] & eor) ^ bg,
+				       dst + 4);
+				dst += 8;
+				break;
+			case 16:
+				for (k = 6; k >= 0; k -= 2, dst += 4)
+					writel((chrome_soft_expand16[(bits >> k) & 3] &
+						eor) ^ bg, dst);
+				break;
+			default:
+				for (k = 7; k >= 0; k--, dst += 4)
+					writel((bits & (1 << k)) ? fg : bg, dst);
+				break;
+			}
+		}
+	}
+}
+
+/*
+ * The per bpp variants, constant bpp lets the compiler do the rest.
+ */
+#define CHROME_SOFT(depth)						\
+static void								\
+chrome_soft_fillrect##depth(struct fb_info *fb_info,			\
+			  const struct fb_fillrect *rect)		\
+{									\
+	chrome_soft_fillrect_bpp(fb_info, rect, depth);			\
+}									\
+									\
+static void								\
+chrome_soft_copyarea##depth(struct fb_info *fb_info,			\
+			  const struct fb_copyarea *area)		\
+{									\
+	chrome_soft_copyarea_bpp(fb_info, area, depth);			\
+}									\
+									\
+static void								\
+chrome_soft_imageblit##depth(struct fb_info *fb_info,			\
+			   const struct fb_image *image)		\
+{									\
+	chrome_soft_imageblit_bpp(fb_info, image, depth);			\
+}									\
+									\
+static const struct chrome_soft chrome_soft##depth = {			\
+	.bpp = depth,							\
+	.fillrect = chrome_soft_fillrect##depth,				\
+	.copyarea = chrome_soft_copyarea##depth,				\
+	.imageblit = chrome_soft_imageblit##depth,			\
+}
+
+CHROME_SOFT(8);
+CHROME_SOFT(16);
+CHROME_SOFT(32);
+
+/*
+ *
+ * Entry points.
+ *
+ */
+void
+chrome_soft_fillrect(struct fb_info *fb_info, const struct fb_fillrect *rect)
+{
+	struct chrome_info *info = (struct chrome_info *) fb_info;
+
+	if (info->soft)
+		info->soft->fillrect(fb_info, rect);
+	else
+		cfb_fillrect(fb_info, rect);
+}
+
+void
+chrome_soft_copyarea(struct fb_info *fb_info, const struct fb_copyarea *area)
+{
+	struct chrome_info *info = (struct chrome_info *) fb_info;
+
+	if (info->soft)
+		info->soft->copyarea(fb_info, area);
+	else
+		cfb_copyarea(fb_info, area);
+}
+
+void
+chrome_soft_imageblit(struct fb_info *fb_info, const struct fb_image *image)
+{
+	struct chrome_info *info = (struct chrome_info *) fb_info;
+
+	if (info->soft)
+		info->soft->imageblit(fb_info, image);
+	else
+		cfb_imageblit(fb_info, image);
+}
+
+/*
+ * From set_par: pick the renderers for the new bpp, and make sure that the
+ * bounce line can hold a full line.
+ */
+void
+chrome_soft_select(struct chrome_info *info)
+{
+	struct fb_info *fb_info = &info->fb_info;
+	u32 size = fb_info->fix.line_length;
+
+	switch (fb_info->var.bits_per_pixel) {
+	case 8:
+		info->soft = &chrome_soft8;
+		break;
+	case 16:
+		info->soft = &chrome_soft16;
+		break;
+	default:
+		info->soft = &chrome_soft32;
+		break;
+	}
+
+	if (size > info->soft_line_size) {
+		kfree(info->soft_line);
+
+		info->soft_line = kmalloc(size, GFP_KERNEL);
+		if (info->soft_line)
+			info->soft_line_size = size;
+		else {
+			printk(KERN_WARNING "%s: no bounce line, copies will be"
+			       " slow.\n", __func__);
+			info->soft_line_size = 0;
+		}
+	}
+}
+
+/*
+ *
+ */
+void
+chrome_soft_init(struct chrome_info *info)
+{
+	int i, j;
+
+	for (i = 0; i < 16; i++) {
+		chrome_soft_expand8[i] = 0;
+		for (j = 0; j < 4; j++)
+			if (i & (0x08 >> j))
+				chrome_soft_expand8[i] |= 0xFFU << (8 * j);
+	}
+
+	for (i = 0; i < 4; i++) {
+		chrome_soft_expand16[i] = 0;
+		if (i & 0x02)
+			chrome_soft_expand16[i] |= 0x0000FFFF;
+		if (i & 0x01)
+			chrome_soft_expand16[i] |= 0xFFFF0000;
+	}
+
+	info->soft = NULL;
+	info->soft_line = NULL;
+	info->soft_line_size = 0;
+}
+
+void
+chrome_soft_exit(struct chrome_info *info)
+{
+	kfree(info->soft_line);
+	info->soft_line = NULL;
+	info->soft_line_size = 0;
+}
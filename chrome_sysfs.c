@@ -0,0 +1,159 @@
+/*
+ * chromefb: driver for VIAs UniChrome and Chrome IGP graphics.
+ *
+ * Copyright (c) 2007 by Luc Verhaegen (libv@skynet.be)
+ *
+ * This file is subject to the terms and conditions of the GNU General
+ * Public License.  See the file COPYING in the main directory of this
+ * archive for more details.
+ *
+ */
+/*
+ * sysfs attributes on the pci device: settings and board properties that
+ * are meant to stay, unlike the debugfs statistics.
+ */
+
+#include <linux/kernel.h>
+#include <linux/fb.h>
+#include <linux/device.h>
+
+#include "chrome.h"
+
+/*
+ *
+ */
+static ssize_t
+chrome_sysfs_split_show(struct device *dev, struct device_attribute *attr,
+			char *buf)
+{
+	struct chrome_info *info = dev_get_drvdata(dev);
+
+	return sprintf(buf, "%u\n", info->split);
+}
+
+static ssize_t
+chrome_sysfs_split_store(struct device *dev, struct device_attribute *attr,
+			 const char *buf, size_t count)
+{
+	struct chrome_info *info = dev_get_drvdata(dev);
+	unsigned long lines;
+	char *end;
+	int ret;
+
+	lines = simple_strtoul(buf, &end, 0);
+	if (end == buf)
+		return -EINVAL;
+
+	chrome_init_wait(info);
+
+	ret = chrome_mode_split(info, lines);
+	if (ret)
+		return ret;
+	return count;
+}
+
+/*
+ * How the cpu reaches the framebuffer, see chrome_fb_init().
+ */
+static ssize_t
+chrome_sysfs_aperture_show(struct device *dev, struct device_attribute *attr,
+			   char *buf)
+{
+	struct chrome_info *info = dev_get_drvdata(dev);
+
+	return sprintf(buf, "%s\n",
+		       (info->fb_aperture == CHROME_APERTURE_DIRECT) ?
+		       "direct" : "pci");
+}
+
+static ssize_t
+chrome_sysfs_aperture_base_show(struct device *dev,
+				struct device_attribute *attr, char *buf)
+{
+	struct chrome_info *info = dev_get_drvdata(dev);
+
+	return sprintf(buf, "0x%08X\n", info->fb_physical);
+}
+
+static ssize_t
+chrome_sysfs_aperture_caching_show(struct device *dev,
+				   struct device_attribute *attr, char *buf)
+{
+	struct chrome_info *info = dev_get_drvdata(dev);
+
+	return sprintf(buf, "%s\n", (info->fb_mtrr >= 0) ?
+		       "write-combining" : "uncached");
+}
+
+/*
+ * Calibration results, see chrome_calibrate.c. They are there once the
+ * deferred part of probe is done.
+ */
+#define CHROME_SYSFS_CALIB(field)					\
+static ssize_t								\
+chrome_sysfs_##field##_show(struct device *dev,				\
+			    struct device_attribute *attr, char *buf)	\
+{									\
+	struct chrome_info *info = dev_get_drvdata(dev);		\
+									\
+	chrome_init_wait(info);						\
+	return sprintf(buf, "%u\n", (unsigned int) info->calib.field);	\
+}
+
+CHROME_SYSFS_CALIB(cpu_write_mbps)
+CHROME_SYSFS_CALIB(cpu_read_mbps)
+CHROME_SYSFS_CALIB(mmio_read_ns)
+CHROME_SYSFS_CALIB(engine_setup_ns)
+CHROME_SYSFS_CALIB(engine_fill_mbps)
+CHROME_SYSFS_CALIB(engine_copy_mbps)
+CHROME_SYSFS_CALIB(fill_min)
+CHROME_SYSFS_CALIB(copy_min)
+CHROME_SYSFS_CALIB(reads_fast)
+CHROME_SYSFS_CALIB(shadow)
+
+#define CHROME_SYSFS_CALIB_ATTR(field) \
+	__ATTR(field, S_IRUGO, chrome_sysfs_##field##_show, NULL)
+
+static struct device_attribute chrome_sysfs_attrs[] = {
+	__ATTR(split, S_IRUGO | S_IWUSR, chrome_sysfs_split_show,
+	       chrome_sysfs_split_store),
+	__ATTR(aperture, S_IRUGO, chrome_sysfs_aperture_show, NULL),
+	__ATTR(aperture_base, S_IRUGO, chrome_sysfs_aperture_base_show, NULL),
+	__ATTR(aperture_caching, S_IRUGO, chrome_sysfs_aperture_caching_show,
+	       NULL),
+	CHROME_SYSFS_CALIB_ATTR(cpu_write_mbps),
+	CHROME_SYSFS_CALIB_ATTR(cpu_read_mbps),
+	CHROME_SYSFS_CALIB_ATTR(mmio_read_ns),
+	CHROME_SYSFS_CALIB_ATTR(engine_setup_ns),
+	CHROME_SYSFS_CALIB_ATTR(engine_fill_mbps),
+	CHROME_SYSFS_CALIB_ATTR(engine_copy_mbps),
+	CHROME_SYSFS_CALIB_ATTR(fill_min),
+	CHROME_SYSFS_CALIB_ATTR(copy_min),
+	CHROME_SYSFS_CALIB_ATTR(reads_fast),
+	CHROME_SYSFS_CALIB_ATTR(shadow),
+};
+
+/*
+ * After pci_set_drvdata(). Missing attributes are not fatal.
+ */
+void
+chrome_sysfs_init(struct chrome_info *info)
+{
+	int i;
+
+	for (i = 0; i < ARRAY_SIZE(chrome_sysfs_attrs); i++)
+		if (device_create_file(info->fb_info.device,
+				       &chrome_sysfs_attrs[i]))
+			printk(KERN_WARNING "%s: failed to create %s.\n",
+			       __func__, chrome_sysfs_attrs[i].attr.name);
+}
+
+void
+chrome_sysfs_exit(struct chrome_info *info)
+{
+	int i;
+
+	for (i = 0; i < ARRAY_SIZE(chrome_sysfs_attrs); i++)
+		device_remove_file(info->fb_info.device,
+				   &chrome_sysfs_attrs[i]);
+}
@@ -0,0 +1,184 @@
+/*
+ * chromefb: driver for VIAs UniChrome and Chrome IGP graphics.
+ *
+ * Copyright (c) 2007 by Luc Verhaegen (libv@skynet.be)
+ *
+ * This file is subject to the terms and conditions of the GNU General
+ * Public License.  See the file COPYING in the main directory of this
+ * archive for more details.
+ *
+ */
+/*
+ * Register write trace.
+ *
+ * The chrome_io.c accessors drop a binary record of every write into a
+ * ring, when trace_enable is set in debugfs. Writers only bump an atomic
+ * head, so any context can trace without locking, and the timing of what
+ * is traced barely changes. The fb ops add a record each, with their
+ * latency and main arguments.
+ *
+ * debugfs/chromefb/<pci id>/trace reads back the ring, oldest record
+ * first. Turn tracing off before reading, or the ring moves underneath.
+ * Writing anything to it empties the ring. tools/tracereplay makes sense
+ * of the result.
+ */
+
+#include <linux/kernel.h>
+#include <linux/fb.h>
+#include <linux/fs.h>
+#include <linux/debugfs.h>
+#include <linux/vmalloc.h>
+#include <asm/uaccess.h>
+
+#include "chrome.h"
+#include "chrome_trace.h"
+
+/* power of two */
+#define CHROME_TRACE_RECORDS 4096
+
+/*
+ * Called from the accessors, only when tracing is on.
+ */
+void
+chrome_trace(struct chrome_info *info, int bank, u32 index, u32 old,
+	     u32 value, int flags)
+{
+	struct chrome_trace_record *record;
+	unsigned int slot;
+
+	if (!info->trace_ring)
+		return;
+
+	slot = atomic_inc_return(&info->trace_head) - 1;
+	record = &info->trace_ring[slot & (CHROME_TRACE_RECORDS - 1)];
+
+	record->time = chrome_time_ns();
+	record->index = index;
+	record->bank = bank;
+	record->flags = flags;
+	record->arg = 0;
+	record->old = old;
+	record->value = value;
+}
+
+/*
+ * From CHROME_TRACE_DONE(), at the end of an op that started at start.
+ */
+void
+chrome_trace_op(struct chrome_info *info, int op, u64 start, int ret,
+		u32 value, u16 arg)
+{
+	struct chrome_trace_record *record;
+	unsigned int slot;
+	u64 end = chrome_time_ns();
+
+	if (!info->trace_ring)
+		return;
+
+	slot = atomic_inc_return(&info->trace_head) - 1;
+	record = &info->trace_ring[slot & (CHROME_TRACE_RECORDS - 1)];
+
+	record->time = start;
+	record->index = op | (((ret < 0) ? (-ret & 0xFF) : 0) << 8);
+	record->bank = CHROME_TRACE_OP;
+	record->flags = 0;
+	record->arg = arg;
+	record->old = end - start;
+	record->value = value;
+}
+
+/*
+ *
+ * debugfs.
+ *
+ */
+static int
+chrome_trace_open(struct inode *inode, struct file *file)
+{
+	file->private_data = inode->i_private;
+	return 0;
+}
+
+/*
+ * Whole records only.
+ */
+static ssize_t
+chrome_trace_read(struct file *file, char __user *buf, size_t count,
+		  loff_t *ppos)
+{
+	struct chrome_info *info = file->private_data;
+	struct chrome_trace_record *record;
+	size_t size = sizeof(struct chrome_trace_record), done = 0;
+	unsigned int head, records, first, i;
+
+	head = atomic_read(&info->trace_head);
+	records = min(head, (unsigned int) CHROME_TRACE_RECORDS);
+	first = head - records;
+
+	if (*ppos >= (loff_t) (records * size))
+		return 0;
+	i = ((unsigned int) *ppos) / size;
+
+	for (; (i < records) && ((done + size) <= count); i++, done += size) {
+		record = &info->trace_ring[(first + i) &
+					   (CHROME_TRACE_RECORDS - 1)];
+		if (copy_to_user(buf + done, record, size))
+			return -EFAULT;
+	}
+
+	*ppos += done;
+	return done;
+}
+
+static ssize_t
+chrome_trace_write(struct file *file, const char __user *buf, size_t count,
+		   loff_t *ppos)
+{
+	struct chrome_info *info = file->private_data;
+
+	atomic_set(&info->trace_head, 0);
+	return count;
+}
+
+static const struct file_operations chrome_trace_fops = {
+	.owner = THIS_MODULE,
+	.open = chrome_trace_open,
+	.read = chrome_trace_read,
+	.write = chrome_trace_write,
+};
+
+/*
+ * Tracing stays unavailable when we cannot get the memory.
+ */
+void
+chrome_trace_init(struct chrome_info *info)
+{
+	info->trace_enable = 0;
+	atomic_set(&info->trace_head, 0);
+
+	info->trace_ring = vmalloc(CHROME_TRACE_RECORDS *
+				   sizeof(struct chrome_trace_record));
+	if (!info->trace_ring) {
+		printk(KERN_WARNING "%s: no memory for the trace ring.\n",
+		       __func__);
+		return;
+	}
+
+	chrome_debugfs_bool(info, "trace_enable", &info->trace_enable);
+	chrome_debugfs_file(info, "trace", S_IRUSR | S_IWUSR, info,
+			    &chrome_trace_fops);
+}
+
+/*
+ * After debugfs is gone.
+ */
+void
+chrome_trace_exit(struct chrome_info *info)
+{
+	info->trace_enable = 0;
+
+	if (info->trace_ring) {
+		vfree(info->trace_ring);
+		info->trace_ring = NULL;
+	}
+}
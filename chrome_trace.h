@@ -0,0 +1,65 @@
+/*
+ * chromefb: driver for VIAs UniChrome and Chrome IGP graphics.
+ *
+ * Copyright (c) 2007 by Luc Verhaegen (libv@skynet.be)
+ *
+ * This file is subject to the terms and conditions of the GNU General
+ * Public License.  See the file COPYING in the main directory of this
+ * archive for more details.
+ *
+ */
+/*
+ * Register write trace, as read from debugfs/chromefb/<pci id>/trace.
+ * Shared with tools/tracereplay, so keep this free of kernel internals.
+ */
+#ifndef HAVE_CHROMEFB_TRACE_H
+#define HAVE_CHROMEFB_TRACE_H
+
+#include <linux/types.h>
+
+#define CHROME_TRACE_MISC    0
+#define CHROME_TRACE_CR      1
+#define CHROME_TRACE_SR      2
+#define CHROME_TRACE_GR      3
+#define CHROME_TRACE_AR      4
+#define CHROME_TRACE_ENABLE  5
+#define CHROME_TRACE_DAC     6 /* index: 0 mask, 1 read address,
+                                * 2 write address, 3 data */
+#define CHROME_TRACE_MMIO    7
+#define CHROME_TRACE_OP      8 /* an fb op, not a register */
+#define CHROME_TRACE_BANKS   9
+
+/* flags */
+#define CHROME_TRACE_OLD   0x01 /* old holds what was in the register */
+#define CHROME_TRACE_MASK  0x02 /* read-modify-write by the driver */
+
+/*
+ * Op records have the op in the low byte of index, and the errno it failed
+ * with, if any, above that. time is the start of the op, old holds its
+ * duration in ns. value and arg are:
+ *
+ *  CHECK_VAR, SET_PAR: xres << 16 | yres, bits_per_pixel.
+ *  PAN: xoffset << 16 | yoffset.
+ *  BLANK: FB_BLANK level.
+ *  SETCMAP: start << 16 | len.
+ *  SYNC: nothing.
+ */
+#define CHROME_TRACE_OP_CHECK_VAR  0
+#define CHROME_TRACE_OP_SET_PAR    1
+#define CHROME_TRACE_OP_PAN        2
+#define CHROME_TRACE_OP_BLANK      3
+#define CHROME_TRACE_OP_SETCMAP    4
+#define CHROME_TRACE_OP_SYNC       5
+#define CHROME_TRACE_OPS           6
+
+struct chrome_trace_record {
+	__u64  time; /* ns */
+	__u32  index;
+	__u8  bank;
+	__u8  flags;
+	__u16  arg; /* op records only */
+	__u32  old;
+	__u32  value;
+};
+
+#endif /* HAVE_CHROMEFB_TRACE_H */
@@ -0,0 +1,133 @@
+/*
+ * chromefb: driver for VIAs UniChrome and Chrome IGP graphics.
+ *
+ * Copyright (c) 2007 by Luc Verhaegen (libv@skynet.be)
+ *
+ * This file is subject to the terms and conditions of the GNU General
+ * Public License.  See the file COPYING in the main directory of this
+ * archive for more details.
+ *
+ */
+/*
+ * VT switches.
+ *
+ * While a userspace client, X usually, has the device open, it programs
+ * the hardware behind our back. When fbcon gets the VT back, it forces a
+ * set_par. Instead of a full modeset, the registers the console image
+ * covers, the PLL, the hardware cursor and the 2D engine are read back
+ * into a snapshot of what the client left, and only what differs from the
+ * console state gets written. Same timing means no sequencer reset and no
+ * PLL relock, so the monitor does not resync either.
+ *
+ * The console side needs no snapshot of its own: that is the register
+ * image for the current mode, the LUT shadow and the engine cache.
+ */
+
+#include <linux/kernel.h>
+#include <linux/fb.h>
+#include <linux/slab.h>
+
+#include "chrome.h"
+#include "chrome_io.h"
+
+/* Hardware icon, as X uses it. fbcon draws its own cursor. */
+#define CHROME_CURSOR_MODE    0x2D0
+#define CHROME_CURSOR_ENABLE  0x01
+
+/*
+ * From set_par. Fails when there is nothing to restore from, or when the
+ * mode asked for is not the one set_par last put up: only the console
+ * getting its own mode back after a switch is worth a differential
+ * restore, anything else, like fbset, gets a full modeset from the caller.
+ */
+int
+chrome_vt_restore(struct chrome_info *info, struct fb_var_screeninfo *mode)
+{
+	struct chrome_vt_snapshot *user = info->vt_user;
+	u64 start;
+	int ret, count;
+
+	if (!info->vt_dirty || !user || !chrome_mode_equal(mode, &info->vt_mode))
+		return -ENODEV;
+
+	start = chrome_time_ns();
+
+	ret = chrome_mode_prepare(info, mode, &info->vt_console);
+	if (ret)
+		return ret;
+
+	/* what the client left */
+	user->stamp = start;
+	chrome_mode_regs_read(info, &info->vt_console, &user->regs);
+	user->cursor = chrome_mmio_read(info, CHROME_CURSOR_MODE);
+
+	count = chrome_mode_replay(info, &info->vt_console, &user->regs);
+
+	if (user->cursor & CHROME_CURSOR_ENABLE) {
+		chrome_mmio_write(info, CHROME_CURSOR_MODE,
+				  user->cursor & ~CHROME_CURSOR_ENABLE);
+		count++;
+	}
+
+	count += chrome_engine_replay(info, user->engine);
+
+	/* keep going differential while a client can still touch things */
+	info->vt_dirty = (atomic_read(&info->vt_clients) > 0);
+
+	info->vt_restores++;
+	info->vt_restore_writes = count;
+	info->vt_restore_ns = chrome_time_ns() - start;
+	if (info->vt_restore_ns > info->vt_restore_max_ns)
+		info->vt_restore_max_ns = info->vt_restore_ns;
+
+	CHROME_DEBUG("%s: %d registers in %uus.\n", __func__, count,
+		     info->vt_restore_ns / 1000);
+	return 0;
+}
+
+/*
+ * A userspace client opened the device.
+ */
+void
+chrome_vt_open(struct chrome_info *info)
+{
+	atomic_inc(&info->vt_clients);
+	info->vt_dirty = 1;
+}
+
+/*
+ * Returns 1 when that was the last one.
+ */
+int
+chrome_vt_release(struct chrome_info *info)
+{
+	return atomic_dec_and_test(&info->vt_clients);
+}
+
+/*
+ * Without the memory, every VT switch is a full modeset.
+ */
+void
+chrome_vt_init(struct chrome_info *info)
+{
+	atomic_set(&info->vt_clients, 0);
+	info->vt_dirty = 0;
+
+	info->vt_user = kzalloc(sizeof(struct chrome_vt_snapshot), GFP_KERNEL);
+	if (!info->vt_user)
+		printk(KERN_WARNING "%s: no memory for VT snapshots.\n",
+		       __func__);
+
+	chrome_debugfs_u32(info, "vt_restores", &info->vt_restores);
+	chrome_debugfs_u32(info, "vt_restore_writes", &info->vt_restore_writes);
+	chrome_debugfs_u32(info, "vt_restore_ns", &info->vt_restore_ns);
+	chrome_debugfs_u32(info, "vt_restore_max_ns",
+			   &info->vt_restore_max_ns);
+}
+
+void
+chrome_vt_exit(struct chrome_info *info)
+{
+	kfree(info->vt_user);
+	info->vt_user = NULL;
+}
@@ -0,0 +1,678 @@
+/*
+ * fbbench: userspace fbdev throughput benchmark.
+ *
+ * Copyright (c) 2007 by Luc Verhaegen (libv@skynet.be)
+ *
+ * This file is subject to the terms and conditions of the GNU General
+ * Public License.  See the file COPYING in the main directory of this
+ * archive for more details.
+ *
+ */
+/*
+ * Drives /dev/fbN through mmap, panning, FBIOPUTCMAP and (optionally) a
+ * console tty, and reports throughput and latency per operation and bpp.
+ *
+ * Nothing in here is chromefb specific, so the same numbers can be
+ * baselined against the kernels vfb module:
+ *     modprobe vfb vfb_enable=1 videomemorysize=16777216
+ *
+ * Usage: fbbench [-d /dev/fbN] [-b 8,16,32] [-n iterations] [-t /dev/ttyN]
+ *                [-o fill,copy,glyph,pan,cmap,console] [-j]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <time.h>
+#include <stdint.h>
+#include <termios.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <linux/fb.h>
+
+#define FBBENCH_OP_FILL     0x01
+#define FBBENCH_OP_COPY     0x02
+#define FBBENCH_OP_GLYPH    0x04
+#define FBBENCH_OP_PAN      0x08
+#define FBBENCH_OP_CMAP     0x10
+#define FBBENCH_OP_CONSOLE  0x20
+#define FBBENCH_OP_ALL      0x3F
+
+/* rectangle size used for fill and copy */
+#define FBBENCH_RECT_W 128
+#define FBBENCH_RECT_H 128
+
+/* glyph size, as for the common 8x16 VGA console font */
+#define FBBENCH_GLYPH_W 8
+#define FBBENCH_GLYPH_H 16
+
+struct fbbench {
+	char *device;
+	char *tty;
+	int iterations;
+	int ops;
+	int json;
+
+	int fd;
+	struct fb_var_screeninfo var;
+	struct fb_var_screeninfo var_orig;
+	struct fb_fix_screeninfo fix;
+	unsigned char *fb;
+	size_t fb_size;
+
+	unsigned long long *samples;
+	int results; /* for json separators */
+};
+
+struct fbbench_result {
+	const char *name;
+	int bpp;
+	int ops;
+	unsigned long long pixels; /* per op, 0 when not meaningful */
+	unsigned long long total_ns;
+	unsigned long long p50, p90, p99, max;
+};
+
+/*
+ *
+ */
+static unsigned long long
+fbbench_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static int
+fbbench_compare(const void *a, const void *b)
+{
+	unsigned long long x = *(const unsigned long long *) a;
+	unsigned long long y = *(const unsigned long long *) b;
+
+	return (x > y) - (x < y);
+}
+
+/*
+ * Sort the samples and hand back the summary.
+ */
+static void
+fbbench_summarise(struct fbbench *bench, struct fbbench_result *result)
+{
+	int n = result->ops;
+	int i;
+
+	result->total_ns = 0;
+	for (i = 0; i < n; i++)
+		result->total_ns += bench->samples[i];
+
+	qsort(bench->samples, n, sizeof(unsigned long long), fbbench_compare);
+
+	result->p50 = bench->samples[(n * 50) / 100];
+	result->p90 = bench->samples[(n * 90) / 100];
+	result->p99 = bench->samples[(n * 99) / 100];
+	result->max = bench->samples[n - 1];
+}
+
+/*
+ *
+ */
+static void
+fbbench_report(struct fbbench *bench, struct fbbench_result *result)
+{
+	double seconds = result->total_ns / 1e9;
+	double ops_s = seconds ? result->ops / seconds : 0;
+	double mpix_s = seconds ?
+		(result->pixels * result->ops) / seconds / 1e6 : 0;
+
+	if (bench->json) {
+		printf("%s\n    {\"op\": \"%s\", \"bpp\": %d, \"ops\": %d, "
+		       "\"ops_per_s\": %.1f, \"mpix_per_s\": %.2f, "
+		       "\"latency_ns\": {\"p50\": %llu, \"p90\": %llu, "
+		       "\"p99\": %llu, \"max\": %llu}}",
+		       bench->results ? "," : "", result->name, result->bpp,
+		       result->ops, ops_s, mpix_s, result->p50, result->p90,
+		       result->p99, result->max);
+	} else {
+		if (!bench->results)
+			printf("%-8s %4s %8s %12s %10s %10s %10s %10s %10s\n",
+			       "op", "bpp", "ops", "ops/s", "MPix/s",
+			       "p50(us)", "p90(us)", "p99(us)", "max(us)");
+		printf("%-8s %4d %8d %12.1f %10.2f %10.1f %10.1f %10.1f %10.1f\n",
+		       result->name, result->bpp, result->ops, ops_s, mpix_s,
+		       result->p50 / 1e3, result->p90 / 1e3,
+		       result->p99 / 1e3, result->max / 1e3);
+	}
+
+	bench->results++;
+}
+
+/*
+ * Solid fill: the cfb_fillrect equivalent, through the mapping.
+ */
+static void
+fbbench_fill(struct fbbench *bench, struct fbbench_result *result)
+{
+	int bytes_per_pixel = (bench->var.bits_per_pixel + 7) >> 3;
+	int w = FBBENCH_RECT_W, h = FBBENCH_RECT_H;
+	int i, j, x, y, line;
+
+	if (w > bench->var.xres)
+		w = bench->var.xres;
+	if (h > bench->var.yres)
+		h = bench->var.yres;
+
+	result->name = "fill";
+	result->pixels = w * h;
+
+	for (i = 0; i < bench->iterations; i++) {
+		unsigned long long start = fbbench_ns();
+		uint32_t pixel = i * 0x01010101;
+
+		x = (i * 37) % (bench->var.xres - w + 1);
+		y = (i * 19) % (bench->var.yres - h + 1);
+
+		for (line = y; line < (y + h); line++) {
+			unsigned char *dst = bench->fb +
+				line * bench->fix.line_length +
+				x * bytes_per_pixel;
+
+			switch (bytes_per_pixel) {
+			case 1:
+				memset(dst, pixel & 0xFF, w);
+				break;
+			case 2:
+				for (j = 0; j < w; j++)
+					((volatile uint16_t *) dst)[j] = pixel;
+				break;
+			default:
+				for (j = 0; j < w; j++)
+					((volatile uint32_t *) dst)[j] = pixel;
+				break;
+			}
+		}
+
+		bench->samples[i] = fbbench_ns() - start;
+	}
+
+	result->ops = bench->iterations;
+}
+
+/*
+ * Screen to screen copy, half a rectangle down: the cfb_copyarea pattern
+ * for scrolling, including reads from the framebuffer.
+ */
+static void
+fbbench_copy(struct fbbench *bench, struct fbbench_result *result)
+{
+	int bytes_per_pixel = (bench->var.bits_per_pixel + 7) >> 3;
+	int w = FBBENCH_RECT_W, h = FBBENCH_RECT_H;
+	int i, x, y, line;
+
+	if (w > bench->var.xres)
+		w = bench->var.xres;
+	if ((2 * h) > bench->var.yres)
+		h = bench->var.yres / 2;
+
+	result->name = "copy";
+	result->pixels = w * h;
+
+	for (i = 0; i < bench->iterations; i++) {
+		unsigned long long start = fbbench_ns();
+
+		x = (i * 37) % (bench->var.xres - w + 1);
+		y = (i * 19) % (bench->var.yres - 2 * h + 1);
+
+		for (line = 0; line < h; line++)
+			memmove(bench->fb + (y + line) * bench->fix.line_length +
+				x * bytes_per_pixel,
+				bench->fb + (y + h + line) * bench->fix.line_length +
+				x * bytes_per_pixel, w * bytes_per_pixel);
+
+		bench->samples[i] = fbbench_ns() - start;
+	}
+
+	result->ops = bench->iterations;
+}
+
+/*
+ * Expand a monochrome glyph in software, as cfb_imageblit does.
+ */
+static void
+fbbench_glyph(struct fbbench *bench, struct fbbench_result *result)
+{
+	int bytes_per_pixel = (bench->var.bits_per_pixel + 7) >> 3;
+	int columns = bench->var.xres / FBBENCH_GLYPH_W;
+	int rows = bench->var.yres / FBBENCH_GLYPH_H;
+	unsigned char glyph[FBBENCH_GLYPH_H];
+	int i, x, y, line, bit;
+
+	for (line = 0; line < FBBENCH_GLYPH_H; line++)
+		glyph[line] = 0x18 ^ (line * 0x11);
+
+	result->name = "glyph";
+	result->pixels = FBBENCH_GLYPH_W * FBBENCH_GLYPH_H;
+
+	for (i = 0; i < bench->iterations; i++) {
+		unsigned long long start = fbbench_ns();
+
+		x = (i % columns) * FBBENCH_GLYPH_W;
+		y = ((i / columns) % rows) * FBBENCH_GLYPH_H;
+
+		for (line = 0; line < FBBENCH_GLYPH_H; line++) {
+			unsigned char *dst = bench->fb +
+				(y + line) * bench->fix.line_length +
+				x * bytes_per_pixel;
+
+			for (bit = 0; bit < FBBENCH_GLYPH_W; bit++) {
+				uint32_t pixel = (glyph[line] & (0x80 >> bit)) ?
+					0xFFFFFFFF : 0;
+
+				switch (bytes_per_pixel) {
+				case 1:
+					((volatile uint8_t *) dst)[bit] = pixel;
+					break;
+				case 2:
+					((volatile uint16_t *) dst)[bit] = pixel;
+					break;
+				default:
+					((volatile uint32_t *) dst)[bit] = pixel;
+					break;
+				}
+			}
+		}
+
+		bench->samples[i] = fbbench_ns() - start;
+	}
+
+	result->ops = bench->iterations;
+}
+
+/*
+ * FBIOPAN_DISPLAY between the top and the bottom of the virtual screen.
+ */
+static int
+fbbench_pan(struct fbbench *bench, struct fbbench_result *result)
+{
+	struct fb_var_screeninfo var = bench->var;
+	int range = bench->var.yres_virtual - bench->var.yres;
+	int i;
+
+	result->name = "pan";
+	result->pixels = 0;
+
+	if (!range || !bench->fix.ypanstep) {
+		fprintf(stderr, "pan: no vertical panning possible, skipped.\n");
+		return -1;
+	}
+
+	for (i = 0; i < bench->iterations; i++) {
+		unsigned long long start = fbbench_ns();
+
+		var.xoffset = 0;
+		var.yoffset = (i & 1) ? range : 0;
+		var.yoffset -= var.yoffset % bench->fix.ypanstep;
+
+		if (ioctl(bench->fd, FBIOPAN_DISPLAY, &var)) {
+			fprintf(stderr, "pan: FBIOPAN_DISPLAY: %s\n",
+				strerror(errno));
+			return -1;
+		}
+
+		bench->samples[i] = fbbench_ns() - start;
+	}
+
+	var.yoffset = 0;
+	ioctl(bench->fd, FBIOPAN_DISPLAY, &var);
+
+	result->ops = bench->iterations;
+	return 0;
+}
+
+/*
+ * FBIOPUTCMAP: full 256 entry LUT when indexed, the 16 console colours
+ * otherwise.
+ */
+static int
+fbbench_cmap(struct fbbench *bench, struct fbbench_result *result)
+{
+	uint16_t red[256], green[256], blue[256];
+	struct fb_cmap cmap;
+	int i, j;
+
+	result->name = "cmap";
+	result->pixels = 0;
+
+	cmap.start = 0;
+	cmap.len = (bench->fix.visual == FB_VISUAL_PSEUDOCOLOR) ? 256 : 16;
+	cmap.red = red;
+	cmap.green = green;
+	cmap.blue = blue;
+	cmap.transp = NULL;
+
+	for (i = 0; i < bench->iterations; i++) {
+		unsigned long long start;
+
+		/* animate: rotate a grey ramp */
+		for (j = 0; j < cmap.len; j++) {
+			red[j] = ((j + i) & 0xFF) << 8;
+			green[j] = red[j];
+			blue[j] = red[j];
+		}
+
+		start = fbbench_ns();
+
+		if (ioctl(bench->fd, FBIOPUTCMAP, &cmap)) {
+			fprintf(stderr, "cmap: FBIOPUTCMAP: %s\n",
+				strerror(errno));
+			return -1;
+		}
+
+		bench->samples[i] = fbbench_ns() - start;
+	}
+
+	result->ops = bench->iterations;
+	return 0;
+}
+
+/*
+ * Full lines to a console tty: this goes through fbcon and so through the
+ * drivers fillrect/copyarea/imageblit, accelerated or not.
+ */
+static int
+fbbench_console(struct fbbench *bench, struct fbbench_result *result)
+{
+	char line[256];
+	int fd, i, len, columns;
+
+	result->name = "console";
+
+	fd = open(bench->tty, O_WRONLY | O_NOCTTY);
+	if (fd < 0) {
+		fprintf(stderr, "console: %s: %s\n", bench->tty,
+			strerror(errno));
+		return -1;
+	}
+
+	columns = bench->var.xres / FBBENCH_GLYPH_W;
+	if (columns > (sizeof(line) - 1))
+		columns = sizeof(line) - 1;
+	/* pixels per line of text, assuming an 8x16 font */
+	result->pixels = columns * FBBENCH_GLYPH_W * FBBENCH_GLYPH_H;
+
+	for (i = 0; i < bench->iterations; i++) {
+		unsigned long long start;
+
+		for (len = 0; len < (columns - 1); len++)
+			line[len] = 0x21 + ((i + len) % 0x5E);
+		line[len++] = '\n';
+
+		start = fbbench_ns();
+
+		if (write(fd, line, len) != len) {
+			fprintf(stderr, "console: write: %s\n",
+				strerror(errno));
+			close(fd);
+			return -1;
+		}
+		/* make sure that fbcon has drawn it */
+		tcdrain(fd);
+
+		bench->samples[i] = fbbench_ns() - start;
+	}
+
+	close(fd);
+
+	result->ops = bench->iterations;
+	return 0;
+}
+
+/*
+ * Switch to the requested bpp, with room for panning, and map.
+ */
+static int
+fbbench_setup(struct fbbench *bench, int bpp)
+{
+	struct fb_var_screeninfo var = bench->var_orig;
+
+	var.bits_per_pixel = bpp;
+	var.xres_virtual = var.xres;
+	var.yres_virtual = var.yres * 2;
+	var.xoffset = 0;
+	var.yoffset = 0;
+	var.activate = FB_ACTIVATE_NOW;
+
+	if (ioctl(bench->fd, FBIOPUT_VSCREENINFO, &var)) {
+		/* retry without the panning room */
+		var.yres_virtual = var.yres;
+		if (ioctl(bench->fd, FBIOPUT_VSCREENINFO, &var)) {
+			fprintf(stderr, "%dbpp: FBIOPUT_VSCREENINFO: %s\n",
+				bpp, strerror(errno));
+			return -1;
+		}
+	}
+
+	if (ioctl(bench->fd, FBIOGET_VSCREENINFO, &bench->var) ||
+	    ioctl(bench->fd, FBIOGET_FSCREENINFO, &bench->fix)) {
+		fprintf(stderr, "%dbpp: FBIOGET_*SCREENINFO: %s\n",
+			bpp, strerror(errno));
+		return -1;
+	}
+
+	if (bench->var.bits_per_pixel != bpp) {
+		fprintf(stderr, "%dbpp: driver gave us %dbpp instead.\n",
+			bpp, bench->var.bits_per_pixel);
+		return -1;
+	}
+
+	bench->fb_size = bench->fix.smem_len;
+	bench->fb = mmap(NULL, bench->fb_size, PROT_READ | PROT_WRITE,
+			 MAP_SHARED, bench->fd, 0);
+	if (bench->fb == MAP_FAILED) {
+		fprintf(stderr, "%dbpp: mmap: %s\n", bpp, strerror(errno));
+		bench->fb = NULL;
+		return -1;
+	}
+
+	return 0;
+}
+
+static void
+fbbench_teardown(struct fbbench *bench)
+{
+	if (bench->fb)
+		munmap(bench->fb, bench->fb_size);
+	bench->fb = NULL;
+}
+
+/*
+ *
+ */
+static void
+fbbench_run(struct fbbench *bench, int bpp)
+{
+	struct fbbench_result result;
+
+	if (fbbench_setup(bench, bpp)) {
+		fbbench_teardown(bench);
+		return;
+	}
+
+	memset(&result, 0, sizeof(result));
+	result.bpp = bpp;
+
+	if (bench->ops & FBBENCH_OP_FILL) {
+		fbbench_fill(bench, &result);
+		fbbench_summarise(bench, &result);
+		fbbench_report(bench, &result);
+	}
+
+	if (bench->ops & FBBENCH_OP_COPY) {
+		fbbench_copy(bench, &result);
+		fbbench_summarise(bench, &result);
+		fbbench_report(bench, &result);
+	}
+
+	if (bench->ops & FBBENCH_OP_GLYPH) {
+		fbbench_glyph(bench, &result);
+		fbbench_summarise(bench, &result);
+		fbbench_report(bench, &result);
+	}
+
+	if ((bench->ops & FBBENCH_OP_PAN) && !fbbench_pan(bench, &result)) {
+		fbbench_summarise(bench, &result);
+		fbbench_report(bench, &result);
+	}
+
+	if ((bench->ops & FBBENCH_OP_CMAP) && !fbbench_cmap(bench, &result)) {
+		fbbench_summarise(bench, &result);
+		fbbench_report(bench, &result);
+	}
+
+	if ((bench->ops & FBBENCH_OP_CONSOLE) && bench->tty &&
+	    !fbbench_console(bench, &result)) {
+		fbbench_summarise(bench, &result);
+		fbbench_report(bench, &result);
+	}
+
+	fbbench_teardown(bench);
+}
+
+/*
+ *
+ */
+static int
+fbbench_ops_parse(char *list)
+{
+	struct {
+		const char *name;
+		int op;
+	} ops[] = {
+		{ "fill", FBBENCH_OP_FILL },
+		{ "copy", FBBENCH_OP_COPY },
+		{ "glyph", FBBENCH_OP_GLYPH },
+		{ "pan", FBBENCH_OP_PAN },
+		{ "cmap", FBBENCH_OP_CMAP },
+		{ "console", FBBENCH_OP_CONSOLE },
+		{ "all", FBBENCH_OP_ALL },
+		{ NULL, 0 }
+	};
+	int mask = 0, i;
+	char *name;
+
+	for (name = strtok(list, ","); name; name = strtok(NULL, ",")) {
+		for (i = 0; ops[i].name; i++)
+			if (!strcmp(name, ops[i].name))
+				break;
+
+		if (!ops[i].name) {
+			fprintf(stderr, "Unknown operation \"%s\".\n", name);
+			return -1;
+		}
+		mask |= ops[i].op;
+	}
+
+	return mask;
+}
+
+static void
+fbbench_usage(const char *name)
+{
+	fprintf(stderr, "Usage: %s [-d /dev/fbN] [-b 8,16,32] [-n iterations]"
+		" [-t /dev/ttyN]\n\t[-o fill,copy,glyph,pan,cmap,console] [-j]\n",
+		name);
+}
+
+int
+main(int argc, char *argv[])
+{
+	struct fbbench bench;
+	char *bpps = NULL, *bpp;
+	int opt;
+
+	memset(&bench, 0, sizeof(bench));
+	bench.device = "/dev/fb0";
+	bench.iterations = 1000;
+	bench.ops = FBBENCH_OP_ALL;
+
+	while ((opt = getopt(argc, argv, "d:b:n:t:o:jh")) != -1) {
+		switch (opt) {
+		case 'd':
+			bench.device = optarg;
+			break;
+		case 'b':
+			bpps = optarg;
+			break;
+		case 'n':
+			bench.iterations = atoi(optarg);
+			break;
+		case 't':
+			bench.tty = optarg;
+			break;
+		case 'o':
+			bench.ops = fbbench_ops_parse(optarg);
+			if (bench.ops < 0)
+				return 1;
+			break;
+		case 'j':
+			bench.json = 1;
+			break;
+		default:
+			fbbench_usage(argv[0]);
+			return 1;
+		}
+	}
+
+	if (bench.iterations < 1) {
+		fbbench_usage(argv[0]);
+		return 1;
+	}
+
+	bench.samples = calloc(bench.iterations, sizeof(unsigned long long));
+	if (!bench.samples)
+		return 1;
+
+	bench.fd = open(bench.device, O_RDWR);
+	if (bench.fd < 0) {
+		fprintf(stderr, "%s: %s\n", bench.device, strerror(errno));
+		return 1;
+	}
+
+	if (ioctl(bench.fd, FBIOGET_VSCREENINFO, &bench.var_orig)) {
+		fprintf(stderr, "FBIOGET_VSCREENINFO: %s\n", strerror(errno));
+		return 1;
+	}
+
+	if (bench.json) {
+		struct fb_fix_screeninfo fix;
+
+		ioctl(bench.fd, FBIOGET_FSCREENINFO, &fix);
+		printf("{\n  \"device\": \"%s\",\n  \"driver\": \"%.16s\",\n"
+		       "  \"xres\": %d,\n  \"yres\": %d,\n  \"iterations\": %d,\n"
+		       "  \"results\": [", bench.device, fix.id,
+		       bench.var_orig.xres, bench.var_orig.yres,
+		       bench.iterations);
+	}
+
+	if (bpps) {
+		for (bpp = strtok(bpps, ","); bpp; bpp = strtok(NULL, ","))
+			fbbench_run(&bench, atoi(bpp));
+	} else
+		fbbench_run(&bench, bench.var_orig.bits_per_pixel);
+
+	if (bench.json)
+		printf("\n  ]\n}\n");
+
+	/* put things back the way we found them */
+	bench.var_orig.activate = FB_ACTIVATE_NOW;
+	ioctl(bench.fd, FBIOPUT_VSCREENINFO, &bench.var_orig);
+
+	close(bench.fd);
+	free(bench.samples);
+
+	return 0;
+}
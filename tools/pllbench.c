@@ -0,0 +1,448 @@
+/*
+ * pllbench: accuracy and cost of the chromefb PLL solvers.
+ *
+ * Copyright (c) 2007 by Luc Verhaegen (libv@skynet.be)
+ *
+ * This file is subject to the terms and conditions of the GNU General
+ * Public License.  See the file COPYING in the main directory of this
+ * archive for more details.
+ *
+ */
+/*
+ * Sweeps every kHz of the dotclock range that chrome_mode_valid() accepts
+ * through the solvers of ../chrome_pll.c, and through an exhaustive search
+ * of the register space for comparison. The exhaustive search knows nothing
+ * about which settings are stable, so it is a lower bound for the error,
+ * not a replacement solver.
+ *
+ * Per clock, the error of the achieved dotclock in ppm, the chosen
+ * divisor/multiplier/shift and the time per solve go to a CSV file. The
+ * summary gives the worst case per variant, and compares the worst error
+ * per MHz against a stored baseline.
+ *
+ * Usage: pllbench [-s start_khz] [-e end_khz] [-r repeats] [-c out.csv]
+ *                 [-b baseline] [-w new_baseline] [-t tolerance_ppm]
+ *
+ * Returns 1 when a regression against the baseline was found.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "chrome_pll.h"
+
+struct pllbench_solution {
+	__u32 pll;
+	int mult, div, shift; /* shift as the actual post divider */
+};
+
+struct pllbench_variant {
+	const char *chip;
+	const char *name;
+	void (*solve)(int clock, struct pllbench_solution *solution);
+
+	/* summary */
+	double worst_ppm;
+	int worst_clock;
+	double total_ppm;
+	double total_ns, worst_ns;
+	int solved, failed;
+
+	/* worst ppm per MHz */
+	double *bucket;
+};
+
+/*
+ *
+ * Solvers.
+ *
+ */
+static void
+pllbench_vt3122_decode(struct pllbench_solution *solution)
+{
+	__u32 pll = solution->pll;
+
+	solution->mult = pll & 0xFF;
+	solution->div = (pll >> 8) & 0x3F;
+	if (pll & 0x8000)
+		solution->shift = 4;
+	else if (pll & 0x4000)
+		solution->shift = 2;
+	else
+		solution->shift = 1;
+}
+
+static void
+pllbench_vt3108_decode(struct pllbench_solution *solution)
+{
+	__u32 pll = solution->pll;
+
+	solution->mult = ((pll >> 16) & 0xFF) + 2;
+	solution->div = (pll & 0x3FF) + 2;
+	solution->shift = 1 << ((pll >> 10) & 0x03);
+}
+
+static void
+pllbench_vt3122_driver(int clock, struct pllbench_solution *solution)
+{
+	int diff;
+
+	solution->pll = vt3122_pll_generate(clock, &diff);
+	pllbench_vt3122_decode(solution);
+}
+
+static void
+pllbench_vt3108_driver(int clock, struct pllbench_solution *solution)
+{
+	int diff;
+
+	solution->pll = vt3108_pll_generate(clock, &diff);
+	pllbench_vt3108_decode(solution);
+}
+
+/*
+ * Everything SR46/SR47 can express: 6bit divisor, multiplier below 129.
+ */
+static void
+pllbench_vt3122_exhaustive(int clock, struct pllbench_solution *solution)
+{
+	static const int shifts[3] = {1, 2, 4};
+	static const __u32 shift_bits[3] = {0x00, 0x40, 0x80};
+	double best = -1, diff;
+	int i, div, mult;
+
+	solution->pll = 0;
+
+	for (i = 0; i < 3; i++) {
+		for (div = 2; div < 64; div++) {
+			long long num = (long long) clock * div * shifts[i];
+
+			mult = (num + CHROME_PLL_REFERENCE / 2) /
+				CHROME_PLL_REFERENCE;
+			if ((mult < 1) || (mult > 128))
+				continue;
+
+			diff = fabs((double) mult * CHROME_PLL_REFERENCE /
+				    (div * shifts[i]) - clock);
+			if ((best < 0) || (diff < best)) {
+				best = diff;
+				solution->pll = ((shift_bits[i] | div) << 8) | mult;
+			}
+		}
+	}
+
+	pllbench_vt3122_decode(solution);
+}
+
+/*
+ * Same, for the VT3108 layout, with the multiplier range the driver uses
+ * and 64bit intermediates.
+ */
+static void
+pllbench_vt3108_exhaustive(int clock, struct pllbench_solution *solution)
+{
+	double best = -1, diff;
+	int shift, div, mult;
+
+	solution->pll = 0;
+
+	for (shift = 0; shift < 4; shift++) {
+		for (div = 2; div < 64; div++) {
+			long long num = (long long) clock * (div << shift);
+
+			mult = (num + CHROME_PLL_REFERENCE / 2) /
+				CHROME_PLL_REFERENCE;
+			if ((mult < 2) || (mult > 257))
+				continue;
+
+			diff = fabs((double) mult * CHROME_PLL_REFERENCE /
+				    (div << shift) - clock);
+			if ((best < 0) || (diff < best)) {
+				best = diff;
+				solution->pll = ((mult - 2) << 16) |
+					(shift << 10) | (div - 2);
+			}
+		}
+	}
+
+	pllbench_vt3108_decode(solution);
+}
+
+static struct pllbench_variant pllbench_variants[] = {
+	{ "vt3122", "driver", pllbench_vt3122_driver },
+	{ "vt3122", "exhaustive", pllbench_vt3122_exhaustive },
+	{ "vt3108", "driver", pllbench_vt3108_driver },
+	{ "vt3108", "exhaustive", pllbench_vt3108_exhaustive },
+	{ NULL, NULL, NULL }
+};
+
+/*
+ *
+ * Sweep.
+ *
+ */
+static double
+pllbench_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+/*
+ * What the hardware does with it: no truncation here.
+ */
+static double
+pllbench_ppm(int clock, struct pllbench_solution *solution)
+{
+	double achieved;
+
+	if (!solution->pll || !solution->div)
+		return 1e6;
+
+	achieved = (double) solution->mult * CHROME_PLL_REFERENCE /
+		(solution->div * solution->shift);
+
+	return fabs(achieved - clock) * 1e6 / clock;
+}
+
+static void
+pllbench_sweep(struct pllbench_variant *variant, int start, int end,
+	       int repeats, FILE *csv)
+{
+	struct pllbench_solution solution;
+	double begin, ns, ppm;
+	int clock, i;
+
+	for (clock = start; clock <= end; clock++) {
+		begin = pllbench_ns();
+		for (i = 0; i < repeats; i++)
+			variant->solve(clock, &solution);
+		ns = (pllbench_ns() - begin) / repeats;
+
+		ppm = pllbench_ppm(clock, &solution);
+
+		if (solution.pll)
+			variant->solved++;
+		else
+			variant->failed++;
+
+		variant->total_ppm += ppm;
+		variant->total_ns += ns;
+		if (ns > variant->worst_ns)
+			variant->worst_ns = ns;
+		if (ppm > variant->worst_ppm) {
+			variant->worst_ppm = ppm;
+			variant->worst_clock = clock;
+		}
+		if (ppm > variant->bucket[clock / 1000])
+			variant->bucket[clock / 1000] = ppm;
+
+		if (csv)
+			fprintf(csv, "%s,%s,%d,0x%06X,%d,%d,%d,%.3f,%.2f,%.1f\n",
+				variant->chip, variant->name, clock,
+				solution.pll, solution.div, solution.mult,
+				solution.shift, solution.pll ?
+				(double) solution.mult * CHROME_PLL_REFERENCE /
+				(solution.div * solution.shift) : 0.0,
+				ppm, ns);
+	}
+}
+
+static void
+pllbench_summary(int start, int end)
+{
+	struct pllbench_variant *variant;
+	int count = end - start + 1;
+
+	printf("%-8s %-11s %10s %10s %10s %9s %9s %7s\n", "chip", "variant",
+	       "worst_ppm", "at_kHz", "mean_ppm", "mean_ns", "worst_ns",
+	       "failed");
+
+	for (variant = pllbench_variants; variant->chip; variant++)
+		printf("%-8s %-11s %10.1f %10d %10.1f %9.1f %9.1f %7d\n",
+		       variant->chip, variant->name, variant->worst_ppm,
+		       variant->worst_clock, variant->total_ppm / count,
+		       variant->total_ns / count, variant->worst_ns,
+		       variant->failed);
+}
+
+/*
+ *
+ * Baseline: "chip variant MHz worst_ppm", one MHz bucket per line.
+ *
+ */
+static struct pllbench_variant *
+pllbench_variant_find(const char *chip, const char *name)
+{
+	struct pllbench_variant *variant;
+
+	for (variant = pllbench_variants; variant->chip; variant++)
+		if (!strcmp(variant->chip, chip) && !strcmp(variant->name, name))
+			return variant;
+	return NULL;
+}
+
+static int
+pllbench_baseline_write(const char *filename, int start, int end)
+{
+	struct pllbench_variant *variant;
+	FILE *file;
+	int mhz;
+
+	file = fopen(filename, "w");
+	if (!file) {
+		perror(filename);
+		return -1;
+	}
+
+	fprintf(file, "# pllbench baseline: chip variant MHz worst_ppm\n");
+	for (variant = pllbench_variants; variant->chip; variant++)
+		for (mhz = start / 1000; mhz <= end / 1000; mhz++)
+			fprintf(file, "%s %s %d %.2f\n", variant->chip,
+				variant->name, mhz, variant->bucket[mhz]);
+
+	fclose(file);
+	return 0;
+}
+
+static int
+pllbench_baseline_compare(const char *filename, int start, int end,
+			  double tolerance)
+{
+	struct pllbench_variant *variant;
+	char line[128], chip[32], name[32];
+	int mhz, compared = 0, regressed = 0, improved = 0;
+	double ppm;
+	FILE *file;
+
+	file = fopen(filename, "r");
+	if (!file) {
+		perror(filename);
+		return -1;
+	}
+
+	while (fgets(line, sizeof(line), file)) {
+		if (line[0] == '#')
+			continue;
+		if (sscanf(line, "%31s %31s %d %lf", chip, name, &mhz, &ppm) != 4)
+			continue;
+		if ((mhz < start / 1000) || (mhz > end / 1000))
+			continue;
+
+		variant = pllbench_variant_find(chip, name);
+		if (!variant)
+			continue;
+
+		compared++;
+		if (variant->bucket[mhz] > (ppm + tolerance)) {
+			printf("regression: %s %s %dMHz: %.2fppm, was %.2fppm\n",
+			       chip, name, mhz, variant->bucket[mhz], ppm);
+			regressed++;
+		} else if (variant->bucket[mhz] < (ppm - tolerance))
+			improved++;
+	}
+	fclose(file);
+
+	printf("baseline: %d buckets compared, %d regressed, %d improved.\n",
+	       compared, regressed, improved);
+	return regressed;
+}
+
+/*
+ *
+ */
+static void
+pllbench_usage(const char *name)
+{
+	fprintf(stderr, "Usage: %s [-s start_khz] [-e end_khz] [-r repeats] "
+		"[-c out.csv]\n\t\t[-b baseline] [-w new_baseline] "
+		"[-t tolerance_ppm]\n", name);
+}
+
+int
+main(int argc, char *argv[])
+{
+	struct pllbench_variant *variant;
+	int start = CHROME_PLL_CLOCK_MIN, end = CHROME_PLL_CLOCK_MAX;
+	int repeats = 8, ret = 0, opt;
+	char *csv_name = NULL, *baseline = NULL, *baseline_new = NULL;
+	double tolerance = 1.0;
+	FILE *csv = NULL;
+
+	while ((opt = getopt(argc, argv, "s:e:r:c:b:w:t:h")) != -1) {
+		switch (opt) {
+		case 's':
+			start = atoi(optarg);
+			break;
+		case 'e':
+			end = atoi(optarg);
+			break;
+		case 'r':
+			repeats = atoi(optarg);
+			break;
+		case 'c':
+			csv_name = optarg;
+			break;
+		case 'b':
+			baseline = optarg;
+			break;
+		case 'w':
+			baseline_new = optarg;
+			break;
+		case 't':
+			tolerance = atof(optarg);
+			break;
+		default:
+			pllbench_usage(argv[0]);
+			return 2;
+		}
+	}
+
+	if ((start < 1000) || (end < start) || (repeats < 1)) {
+		pllbench_usage(argv[0]);
+		return 2;
+	}
+
+	if (csv_name) {
+		csv = fopen(csv_name, "w");
+		if (!csv) {
+			perror(csv_name);
+			return 2;
+		}
+		fprintf(csv, "chip,variant,clock_khz,pll,div,mult,shift,"
+			"achieved_khz,error_ppm,ns_per_solve\n");
+	}
+
+	for (variant = pllbench_variants; variant->chip; variant++) {
+		variant->bucket = calloc(end / 1000 + 1, sizeof(double));
+		if (!variant->bucket) {
+			perror("calloc");
+			return 2;
+		}
+
+		pllbench_sweep(variant, start, end, repeats, csv);
+	}
+
+	if (csv)
+		fclose(csv);
+
+	pllbench_summary(start, end);
+
+	if (baseline) {
+		ret = pllbench_baseline_compare(baseline, start, end, tolerance);
+		if (ret < 0)
+			return 2;
+		ret = ret ? 1 : 0;
+	}
+
+	if (baseline_new && pllbench_baseline_write(baseline_new, start, end))
+		return 2;
+
+	return ret;
+}
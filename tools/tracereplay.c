@@ -0,0 +1,345 @@
+/*
+ * tracereplay: make sense of a chromefb register write trace.
+ *
+ * Copyright (c) 2007 by Luc Verhaegen (libv@skynet.be)
+ *
+ * This file is subject to the terms and conditions of the GNU General
+ * Public License.  See the file COPYING in the main directory of this
+ * archive for more details.
+ *
+ */
+/*
+ * Replays a trace, as read from debugfs/chromefb/<pci id>/trace, against a
+ * simulated register file, and reports where the time and the accesses
+ * went, per register bank:
+ *
+ *  - writes, and how many of those were read-modify-write.
+ *  - redundant writes: the register already held the value.
+ *  - mismatches: the old value traced differs from what the simulation
+ *    holds, so something else touched the register in between.
+ *  - estimated cost: bus accesses per write times a per access cost.
+ *  - measured cost: time since the previous record, with gaps longer than
+ *    the gap threshold (retrace waits, sleeps) accounted separately.
+ *
+ * fb op records are not replayed, they give count, failures and latency
+ * per op instead.
+ *
+ * Usage: tracereplay [-a vga_ns] [-m mmio_ns] [-g gap_us] [-n top] [-v]
+ *                    trace
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "chrome_trace.h"
+
+static const char *bank_names[CHROME_TRACE_BANKS] = {
+	"Misc", "CR", "SR", "GR", "AR", "Enable", "DAC", "MMIO", "Op",
+};
+
+static const char *op_names[CHROME_TRACE_OPS] = {
+	"check_var", "set_par", "pan", "blank", "setcmap", "sync",
+};
+
+struct replay_op {
+	unsigned int count, failed;
+	double total_us, worst_us;
+};
+
+static struct replay_op ops[CHROME_TRACE_OPS];
+
+/* registers per bank in the simulation, MMIO is in 32bit words */
+#define REPLAY_REGS 0x2400
+
+struct replay_reg {
+	unsigned int value;
+	int known;
+};
+
+struct replay_bank {
+	struct replay_reg *regs;
+
+	unsigned int writes, masked, redundant, mismatches;
+	double estimated_ns, measured_ns;
+};
+
+struct replay_gap {
+	double us;
+	unsigned int record;
+	int bank;
+	unsigned int index;
+};
+
+static struct replay_bank banks[CHROME_TRACE_BANKS];
+
+/*
+ * Bus accesses that the chrome_io.c accessor does for this write.
+ */
+static int
+replay_accesses(const struct chrome_trace_record *record)
+{
+	int mask = record->flags & CHROME_TRACE_MASK;
+
+	switch (record->bank) {
+	case CHROME_TRACE_CR:
+	case CHROME_TRACE_SR:
+	case CHROME_TRACE_GR:
+		return mask ? 3 : 2; /* index, (read,) write */
+	case CHROME_TRACE_AR:
+		return mask ? 9 : 7; /* flip-flop resets and index restore */
+	case CHROME_TRACE_MISC:
+	case CHROME_TRACE_ENABLE:
+		return mask ? 2 : 1;
+	default:
+		return 1;
+	}
+}
+
+/*
+ *
+ */
+static struct replay_reg *
+replay_reg(const struct chrome_trace_record *record)
+{
+	unsigned int index = record->index;
+
+	if (record->bank == CHROME_TRACE_MMIO)
+		index >>= 2;
+	if ((record->bank >= CHROME_TRACE_BANKS) || (index >= REPLAY_REGS))
+		return NULL;
+
+	return &banks[record->bank].regs[index];
+}
+
+/*
+ * Op records are written when the op is done, with the time it started.
+ */
+static void
+replay_op(const struct chrome_trace_record *record, int verbose,
+	  unsigned long long first)
+{
+	unsigned int op = record->index & 0xFF, error = record->index >> 8;
+	double us = record->old / 1000.0;
+
+	if (op >= CHROME_TRACE_OPS)
+		return;
+
+	ops[op].count++;
+	if (error)
+		ops[op].failed++;
+	ops[op].total_us += us;
+	if (us > ops[op].worst_us)
+		ops[op].worst_us = us;
+
+	if (verbose)
+		printf("%12.3f Op     %-9s 0x%08X %u: %.1fus%s\n",
+		       first ? (record->time - first) / 1000.0 : 0.0,
+		       op_names[op], record->value, record->arg, us,
+		       error ? " FAILED" : "");
+}
+
+static int
+replay_gap_compare(const void *a, const void *b)
+{
+	const struct replay_gap *x = a, *y = b;
+
+	if (x->us < y->us)
+		return 1;
+	if (x->us > y->us)
+		return -1;
+	return 0;
+}
+
+static void
+replay_usage(const char *name)
+{
+	fprintf(stderr, "Usage: %s [-a vga_ns] [-m mmio_ns] [-g gap_us] "
+		"[-n top] [-v] trace\n", name);
+	exit(2);
+}
+
+int
+main(int argc, char *argv[])
+{
+	struct chrome_trace_record record;
+	struct replay_reg *reg;
+	struct replay_bank *bank;
+	struct replay_gap *gaps = NULL;
+	unsigned int records = 0, writes = 0, ngaps = 0, maxgaps = 0, i;
+	unsigned int top = 10;
+	unsigned long long first = 0, last = 0;
+	double vga_ns = 200.0, mmio_ns = 50.0, gap_us = 100.0, delta, idle = 0;
+	double estimated = 0, measured = 0;
+	int verbose = 0, opt, redundant, mismatch;
+	FILE *file;
+
+	while ((opt = getopt(argc, argv, "a:m:g:n:vh")) != -1) {
+		switch (opt) {
+		case 'a':
+			vga_ns = atof(optarg);
+			break;
+		case 'm':
+			mmio_ns = atof(optarg);
+			break;
+		case 'g':
+			gap_us = atof(optarg);
+			break;
+		case 'n':
+			top = atoi(optarg);
+			break;
+		case 'v':
+			verbose = 1;
+			break;
+		default:
+			replay_usage(argv[0]);
+		}
+	}
+
+	if (optind != (argc - 1))
+		replay_usage(argv[0]);
+
+	file = fopen(argv[optind], "rb");
+	if (!file) {
+		perror(argv[optind]);
+		return 1;
+	}
+
+	for (i = 0; i < CHROME_TRACE_BANKS; i++) {
+		banks[i].regs = calloc(REPLAY_REGS, sizeof(struct replay_reg));
+		if (!banks[i].regs) {
+			fprintf(stderr, "Out of memory.\n");
+			return 1;
+		}
+	}
+
+	while (fread(&record, sizeof(record), 1, file) == 1) {
+		if (record.bank == CHROME_TRACE_OP) {
+			replay_op(&record, verbose, first);
+			records++;
+			continue;
+		}
+
+		reg = replay_reg(&record);
+		if (!reg) {
+			fprintf(stderr, "Record %u: bogus bank %d or index "
+				"0x%X, skipped.\n", records, record.bank,
+				record.index);
+			records++;
+			continue;
+		}
+		bank = &banks[record.bank];
+
+		if (!first)
+			first = last = record.time;
+		delta = (record.time - last) / 1000.0; /* us */
+		last = record.time;
+
+		redundant = 0;
+		mismatch = 0;
+		if ((record.flags & CHROME_TRACE_OLD) && reg->known &&
+		    (reg->value != record.old))
+			mismatch = 1;
+		if (record.flags & CHROME_TRACE_OLD)
+			redundant = (record.old == record.value);
+		else if (reg->known)
+			redundant = (reg->value == record.value);
+
+		/* the DAC data port is a stream, not a register */
+		if ((record.bank == CHROME_TRACE_DAC) && (record.index == 3))
+			redundant = 0;
+
+		bank->writes++;
+		if (record.flags & CHROME_TRACE_MASK)
+			bank->masked++;
+		bank->redundant += redundant;
+		bank->mismatches += mismatch;
+
+		bank->estimated_ns += replay_accesses(&record) *
+			((record.bank == CHROME_TRACE_MMIO) ? mmio_ns : vga_ns);
+
+		if (delta > gap_us) {
+			idle += delta;
+			if (ngaps == maxgaps) {
+				maxgaps = maxgaps ? 2 * maxgaps : 64;
+				gaps = realloc(gaps, maxgaps * sizeof(*gaps));
+				if (!gaps) {
+					fprintf(stderr, "Out of memory.\n");
+					return 1;
+				}
+			}
+			gaps[ngaps].us = delta;
+			gaps[ngaps].record = records;
+			gaps[ngaps].bank = record.bank;
+			gaps[ngaps].index = record.index;
+			ngaps++;
+		} else
+			bank->measured_ns += delta * 1000.0;
+
+		reg->value = record.value;
+		reg->known = 1;
+
+		if (verbose)
+			printf("%12.3f %-6s 0x%03X 0x%08X -> 0x%08X%s%s%s\n",
+			       (record.time - first) / 1000.0,
+			       bank_names[record.bank], record.index,
+			       record.old, record.value,
+			       (record.flags & CHROME_TRACE_OLD) ? "" : " (old?)",
+			       redundant ? " redundant" : "",
+			       mismatch ? " MISMATCH" : "");
+
+		records++;
+	}
+	fclose(file);
+
+	if (!records) {
+		printf("Empty trace.\n");
+		return 0;
+	}
+
+	printf("%u records over %.3fms, %.3fms of which in %u gaps over "
+	       "%.0fus.\n\n", records, (last - first) / 1000000.0,
+	       idle / 1000.0, ngaps, gap_us);
+
+	printf("%-7s %8s %8s %9s %10s %12s %12s\n", "Bank", "Writes",
+	       "Masked", "Redundant", "Mismatches", "Est. us", "Meas. us");
+	for (i = 0; i < CHROME_TRACE_BANKS; i++) {
+		bank = &banks[i];
+		if (!bank->writes)
+			continue;
+		printf("%-7s %8u %8u %9u %10u %12.1f %12.1f\n", bank_names[i],
+		       bank->writes, bank->masked, bank->redundant,
+		       bank->mismatches, bank->estimated_ns / 1000.0,
+		       bank->measured_ns / 1000.0);
+		writes += bank->writes;
+		estimated += bank->estimated_ns;
+		measured += bank->measured_ns;
+	}
+	printf("%-7s %8u %8s %9s %10s %12.1f %12.1f\n", "Total", writes,
+	       "", "", "", estimated / 1000.0, measured / 1000.0);
+
+	printf("\n");
+	for (i = 0; i < CHROME_TRACE_OPS; i++) {
+		if (!ops[i].count)
+			continue;
+		printf("%-9s %6u calls, %u failed, %10.1fus average, %10.1fus "
+		       "worst\n", op_names[i], ops[i].count, ops[i].failed,
+		       ops[i].total_us / ops[i].count, ops[i].worst_us);
+	}
+
+	if (ngaps && top) {
+		qsort(gaps, ngaps, sizeof(*gaps), replay_gap_compare);
+		printf("\nLongest gaps, before:\n");
+		for (i = 0; (i < ngaps) && (i < top); i++)
+			printf("  %10.1fus  record %6u: %s 0x%03X\n", gaps[i].us,
+			       gaps[i].record, bank_names[gaps[i].bank],
+			       gaps[i].index);
+	}
+
+	free(gaps);
+	for (i = 0; i < CHROME_TRACE_BANKS; i++)
+		free(banks[i].regs);
+
+	return 0;
+}